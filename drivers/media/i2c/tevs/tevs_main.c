@@ -1,12 +1,19 @@
 #include "asm-generic/errno-base.h"
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
+#include <linux/interrupt.h>
 #include <linux/module.h>
 #include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
@@ -215,6 +222,10 @@
 #define TEVS_SHARPEN_MAX 						HOST_COMMAND_ISP_CTRL_SHARPEN_MAX
 #define TEVS_SHARPEN_MIN 						HOST_COMMAND_ISP_CTRL_SHARPEN_MIN
 #define TEVS_SHARPEN_MASK 						(0xFFFF)
+#define TEVS_DENOISE 							HOST_COMMAND_ISP_CTRL_DENOISE
+#define TEVS_DENOISE_MAX 						HOST_COMMAND_ISP_CTRL_DENOISE_MAX
+#define TEVS_DENOISE_MIN 						HOST_COMMAND_ISP_CTRL_DENOISE_MIN
+#define TEVS_DENOISE_MASK 						(0xFFFF)
 #define TEVS_BACKLIGHT_COMPENSATION 			HOST_COMMAND_ISP_CTRL_BACKLIGHT_COMPENSATION
 #define TEVS_BACKLIGHT_COMPENSATION_MAX 		HOST_COMMAND_ISP_CTRL_BACKLIGHT_COMPENSATION_MAX
 #define TEVS_BACKLIGHT_COMPENSATION_MIN 		HOST_COMMAND_ISP_CTRL_BACKLIGHT_COMPENSATION_MIN
@@ -253,6 +264,192 @@
 #define TEVS_BSL_MODE_NORMAL_IDX 		    (0U << 0)
 #define TEVS_BSL_MODE_FLASH_IDX 			(1U << 0)
 
+#define V4L2_CID_TEVS_BRACKET_SEQ         (V4L2_CID_USER_BASE + 45)
+#define V4L2_CID_TEVS_BRACKET_COUNT       (V4L2_CID_USER_BASE + 46)
+#define V4L2_CID_TEVS_BRACKET_INDEX       (V4L2_CID_USER_BASE + 47)
+#define TEVS_BRACKET_MAX_STEPS            (16)
+#define TEVS_BRACKET_STEP_EXP             (0)
+#define TEVS_BRACKET_STEP_GAIN            (1)
+/* Frames between writing exposure/gain and the ISP applying them */
+#define TEVS_BRACKET_LATENCY              (1)
+#define TEVS_BRACKET_HISTORY              (4)
+
+#define V4L2_CID_TEVS_EPTZ                (V4L2_CID_USER_BASE + 48)
+#define V4L2_CID_TEVS_EPTZ_FRAMES         (V4L2_CID_USER_BASE + 49)
+#define TEVS_EPTZ_PAN                     (0)
+#define TEVS_EPTZ_TILT                    (1)
+#define TEVS_EPTZ_ZOOM                    (2)
+#define TEVS_EPTZ_AXES                    (3)
+#define TEVS_EPTZ_MAX_FRAMES              (255)
+
+#define V4L2_CID_TEVS_AE_MAX_EXPOSURE     (V4L2_CID_USER_BASE + 50)
+#define V4L2_CID_TEVS_CSI_THROUGHPUT      (V4L2_CID_USER_BASE + 51)
+#define TEVS_CSI_THROUGHPUT_MAX           (2400) /* Mbit/s, 2 lanes */
+#define TEVS_BITS_PER_PIXEL               (16)   /* UYVY8_2X8 */
+
+#define V4L2_CID_TEVS_DENOISE             (V4L2_CID_USER_BASE + 52)
+#define V4L2_CID_TEVS_LATENCY_PROFILE     (V4L2_CID_USER_BASE + 53)
+#define TEVS_LATENCY_PROFILE_DEFAULT_IDX  (0U << 0)
+#define TEVS_LATENCY_PROFILE_LOW_IDX      (1U << 0)
+
+#define V4L2_CID_TEVS_TRIGGER_MODE        (V4L2_CID_USER_BASE + 55)
+#define V4L2_CID_TEVS_SOFTWARE_TRIGGER    (V4L2_CID_USER_BASE + 56)
+#define TEVS_TRIGGER_PULSE_US             (100)
+#define TEVS_TRIGGER_ACK_TIMEOUT          (100)
+
+#define V4L2_CID_TEVS_SYNC_ROLE           (V4L2_CID_USER_BASE + 57)
+#define V4L2_CID_TEVS_SYNC_SKEW           (V4L2_CID_USER_BASE + 58)
+#define TEVS_SYNC_ROLE_FREE_RUN           (0)
+#define TEVS_SYNC_ROLE_MASTER             (1)
+#define TEVS_SYNC_ROLE_SLAVE              (2)
+#define TEVS_SYNC_SKEW_MAX                (1000000) /* us */
+
+#define V4L2_CID_TEVS_TRIGGER_PERIOD      (V4L2_CID_USER_BASE + 59)
+#define V4L2_CID_TEVS_TRIGGER_PULSE       (V4L2_CID_USER_BASE + 60)
+#define V4L2_CID_TEVS_TRIGGER_COUNT       (V4L2_CID_USER_BASE + 61)
+#define V4L2_CID_TEVS_TRIGGER_GROUP       (V4L2_CID_USER_BASE + 62)
+#define V4L2_CID_TEVS_TRIGGER_MISSED      (V4L2_CID_USER_BASE + 63)
+#define TEVS_TRIGGER_PERIOD_MIN           (1000)     /* us */
+#define TEVS_TRIGGER_PERIOD_MAX           (10000000) /* us */
+#define TEVS_TRIGGER_PULSE_MAX            (100000)   /* us */
+#define TEVS_TRIGGER_GROUP_MAX            (255)
+#define TEVS_TRIGGER_MEMBERS_MAX          (8)
+/* Delay of a pulse past its slot reported as late */
+#define TEVS_TRIGGER_LATE_US              (1000)
+
+#define V4L2_CID_TEVS_STROBE_MODE         (V4L2_CID_USER_BASE + 64)
+#define V4L2_CID_TEVS_STROBE_INTERVAL     (V4L2_CID_USER_BASE + 65)
+#define TEVS_STROBE_MODE_EVERY_FRAME      (0)
+#define TEVS_STROBE_MODE_EVERY_NTH        (1)
+#define TEVS_STROBE_MODE_ON_TRIGGER       (2)
+#define TEVS_STROBE_DURATION_DEF          (1000)   /* us */
+#define TEVS_STROBE_DURATION_MAX          (100000) /* us */
+#define TEVS_STROBE_INTERVAL_MAX          (255)
+
+#define V4L2_CID_TEVS_AE_SEED             (V4L2_CID_USER_BASE + 66)
+#define V4L2_CID_TEVS_AE_CONVERGED        (V4L2_CID_USER_BASE + 67)
+/* AE is converged after this many frames within the tolerance */
+#define TEVS_CONVERGE_FRAMES              (3)
+#define TEVS_CONVERGE_TOLERANCE_PCT       (3)
+
+#define V4L2_CID_TEVS_STILL_MODE          (V4L2_CID_USER_BASE + 68)
+#define V4L2_CID_TEVS_STILL_FRAMES        (V4L2_CID_USER_BASE + 69)
+#define V4L2_CID_TEVS_STILL_CAPTURE       (V4L2_CID_USER_BASE + 70)
+#define TEVS_STILL_MAX_FRAMES             (255)
+/* Frames after a mode switch before the output has the new mode */
+#define TEVS_STILL_LATENCY                (1)
+
+/*
+ * With Stream_Async set, STREAMON returns before the ISP is up. The link
+ * only runs once TEVS_EVENT_STREAM reports the start without an error.
+ */
+#define V4L2_CID_TEVS_STREAM_ASYNC        (V4L2_CID_USER_BASE + 71)
+
+#define V4L2_CID_TEVS_CTRL_QUEUE          (V4L2_CID_USER_BASE + 72)
+#define V4L2_CID_TEVS_CTRL_QUEUE_STATS    (V4L2_CID_USER_BASE + 73)
+#define TEVS_CMDQ_DEPTH                   (32)
+#define TEVS_CMDQ_WINDOW_MS               (2)
+/* Ctrl_Queue_Stats layout */
+#define TEVS_CMDQ_STAT_DEPTH              (0) /* controls waiting now */
+#define TEVS_CMDQ_STAT_PEAK               (1) /* most controls waiting */
+#define TEVS_CMDQ_STAT_QUEUED             (2) /* writes taken by the queue */
+#define TEVS_CMDQ_STAT_COALESCED          (3) /* writes folded into another */
+#define TEVS_CMDQ_STAT_TRANSFERS          (4) /* I2C transfers of the drains */
+#define TEVS_CMDQ_STATS                   (5)
+
+/* Gray levels the frame counter pattern steps through, one per frame */
+#define TEVS_TEST_PATTERN_LEVELS          (16)
+
+/* Sensor register accesses in one debugfs sensor_regs write */
+#define TEVS_SENSOR_BATCH_MAX             (256)
+
+/* The control registers replayed in bulk at stream start */
+#define TEVS_CTRL_IMAGE_BASE              HOST_COMMAND_ISP_CTRL_AE_MODE
+#define TEVS_CTRL_IMAGE_SIZE \
+	(HOST_COMMAND_ISP_CTRL_SYSTEM_START - TEVS_CTRL_IMAGE_BASE)
+
+#define V4L2_CID_TEVS_PRESET_SAVE         (V4L2_CID_USER_BASE + 74)
+#define V4L2_CID_TEVS_PRESET_APPLY        (V4L2_CID_USER_BASE + 75)
+#define V4L2_CID_TEVS_PRESET_DELETE       (V4L2_CID_USER_BASE + 76)
+#define V4L2_CID_TEVS_PRESET_LIST         (V4L2_CID_USER_BASE + 77)
+#define TEVS_PRESET_SLOTS                 (8)
+#define TEVS_PRESET_NAME_LEN              (16)
+#define TEVS_PRESET_CTRLS                 (32)
+/* Header of the presets sysfs file */
+#define TEVS_PRESET_MAGIC                 (0x52505654) /* "TVPR" */
+#define TEVS_PRESET_VERSION               (1)
+
+#define V4L2_CID_TEVS_WATCHDOG            (V4L2_CID_USER_BASE + 78)
+#define TEVS_WATCHDOG_PERIOD_MS           (1000)
+/* Consecutive failed transfers taken as a hung ISP */
+#define TEVS_WATCHDOG_I2C_ERRORS          (4)
+#define TEVS_RECOVERY_SOFT_RESET          (0)
+#define TEVS_RECOVERY_POWER_CYCLE         (1)
+
+/*
+ * Private events, payload is carried in v4l2_event.u.data
+ */
+#define TEVS_EVENT_BRACKET                (V4L2_EVENT_PRIVATE_START + 0)
+#define TEVS_EVENT_SHUTTER                (V4L2_EVENT_PRIVATE_START + 1)
+#define TEVS_EVENT_TRIGGER                (V4L2_EVENT_PRIVATE_START + 2)
+#define TEVS_EVENT_AE_CONVERGED           (V4L2_EVENT_PRIVATE_START + 3)
+#define TEVS_EVENT_STILL                  (V4L2_EVENT_PRIVATE_START + 4)
+#define TEVS_EVENT_STREAM                 (V4L2_EVENT_PRIVATE_START + 5)
+#define TEVS_EVENT_RECOVERY               (V4L2_EVENT_PRIVATE_START + 6)
+#define TEVS_EVENT_QUEUE_DEPTH            (8)
+
+/* Bounds of the frame-sync-poll-us property */
+#define TEVS_FRAME_SYNC_POLL_MIN_US       (250)
+#define TEVS_FRAME_SYNC_POLL_MAX_US       (10000)
+
+struct tevs_event_bracket {
+	__u32 sequence;     /* frame sequence number */
+	__s32 index;        /* bracket step used by this frame, -1 if unknown */
+	__u32 exposure;     /* exposure time of the step in us */
+	__u32 gain;         /* gain of the step */
+} __attribute__((packed));
+
+struct tevs_event_shutter {
+	__u32 sequence;     /* shutter count since stream start */
+	__u32 reserved;
+	__u64 timestamp;    /* start of exposure, CLOCK_MONOTONIC in ns */
+} __attribute__((packed));
+
+struct tevs_event_trigger {
+	__u32 sequence;     /* generated triggers since stream start */
+	__u32 missed;       /* slots skipped before this trigger */
+	__u32 late;         /* delay of this trigger past its slot in us */
+} __attribute__((packed));
+
+struct tevs_event_ae_converged {
+	__u32 sequence;     /* frame sequence number */
+	__u32 frames;       /* frames taken since start or the scene change */
+	__u32 exposure;     /* converged exposure time in us */
+	__u16 gain;         /* converged gain */
+} __attribute__((packed));
+
+struct tevs_event_still {
+	__u32 sequence;     /* first frame of the burst */
+	__u32 frames;       /* frames in the burst */
+	__u16 width;        /* still frame size */
+	__u16 height;
+} __attribute__((packed));
+
+struct tevs_event_stream {
+	__s32 error;        /* 0 once streaming, negative errno otherwise */
+	__u32 sequence;     /* first frame with the programmed mode */
+	__u32 duration;     /* time from STREAMON to completion in us */
+} __attribute__((packed));
+
+struct tevs_event_recovery {
+	__s32 error;        /* 0 once streaming again, negative errno otherwise */
+	__u32 method;       /* TEVS_RECOVERY_* */
+	__u32 duration;     /* time from detection to streaming again in us */
+	__u32 count;        /* recoveries since probe */
+} __attribute__((packed));
+
+#define TEVS_PREVIEW_FORMAT_UYVY          (0x50)
+
 #define DEFAULT_HEADER_VERSION 3
 #define TEVS_BOOT_TIME						(250)
 
@@ -291,6 +488,56 @@ struct header_info {
 	u16 total_checksum;
 } __attribute__((packed));
 
+/*
+ * Periodic trigger generator, shared by the members of a trigger group.
+ * The trigger lines sit on the I2C GPIO expander, so the timer only
+ * schedules the pulse and the work drives the lines.
+ */
+struct tevs_trigger_timer {
+	struct list_head entry;
+	struct list_head members;
+	struct hrtimer timer;
+	struct work_struct work;
+	ktime_t period;
+	ktime_t expires;
+	u32 pulse;
+	u32 count;
+	u32 fired;
+	u32 group;
+	unsigned int nr_members;
+	atomic_t missed;
+};
+
+struct tevs_snapshot {
+	struct v4l2_mbus_framefmt fmt;
+	u16 frame_rate;
+	bool streaming;
+};
+
+/* A named set of control values, the slot is free while name is empty */
+struct tevs_preset {
+	char name[TEVS_PRESET_NAME_LEN];
+	__u32 count;
+	struct {
+		__u32 id;
+		__s32 val;
+	} ctrls[TEVS_PRESET_CTRLS];
+} __attribute__((packed));
+
+/* Contents of the presets sysfs file, little endian whatever the host */
+struct tevs_preset_blob {
+	__le32 magic;
+	__le32 version;
+	struct {
+		char name[TEVS_PRESET_NAME_LEN];
+		__le32 count;
+		struct {
+			__le32 id;
+			__le32 val;
+		} ctrls[TEVS_PRESET_CTRLS];
+	} __attribute__((packed)) slots[TEVS_PRESET_SLOTS];
+} __attribute__((packed));
+
 struct tevs {
 	struct v4l2_subdev v4l2_subdev;
 	struct media_pad pad;
@@ -302,11 +549,17 @@ struct tevs {
 	struct header_info *header_info;
 	struct gpio_desc *reset_gpio;
 	struct gpio_desc *standby_gpio;
+	struct gpio_desc *trigger_gpio;
+	struct gpio_desc *shutter_gpio;
+	struct gpio_desc *frame_sync_gpio;
+	struct gpio_desc *flash_gpio;
 
 	struct regulator_bulk_data supplies[TEVS_NUM_SUPPLIES];
 
 	/* V4L2 Controls */
 	struct v4l2_ctrl_handler ctrls;
+	/* Created controls, indexed like tevs_ctrls[] */
+	struct v4l2_ctrl **ctrl_list;
 
 	int data_lanes;
 	int continuous_clock;
@@ -318,27 +571,261 @@ struct tevs {
 	u8 selected_sensor;
 
 	/*
-	 * Mutex for serialized access:
-	 * Protect sensor module set pad format and start/stop streaming safely.
+	 * Lock order is stream_lock, mutex, i2c_lock. stream_lock serialises
+	 * stream on/off and live mode switches, and is held across the ISP
+	 * wake up and standby polls.
+	 * mutex protects the format, mode and control state, it is also the
+	 * control handler lock and is not held while waiting on the ISP.
+	 * i2c_lock serialises register access.
 	 */
+	struct mutex stream_lock;
 	struct mutex mutex;
+	struct mutex i2c_lock;
+
+	/* Format and frame interval published for lockless readers */
+	seqlock_t snapshot_lock;
+	struct tevs_snapshot snapshot;
 
 	/* Streaming on/off */
 	bool streaming;
+
+	/* Exposures reported by the SHUTTER line */
+	atomic_t shutter_sequence;
+
+	/* Frame timing, one tick per frame while streaming */
+	struct hrtimer frame_timer;
+	struct work_struct frame_work;
+	ktime_t frame_period;
+	atomic_t frame_sequence;
+	/* Last frame start seen on FRAME_SYNC */
+	ktime_t frame_timestamp;
+
+	/*
+	 * Frame start from the FRAME_SYNC line interrupt. A line that cannot
+	 * interrupt is only sampled from frame_timer when frame-sync-poll-us
+	 * opts in, as every sample is a transfer on the shared bus.
+	 */
+	int frame_sync_irq;
+	u32 frame_sync_poll_us;
+	bool frame_sync_active;
+	bool frame_sync_level;
+	struct work_struct frame_sync_work;
+
+	/* Exposure bracketing */
+	struct {
+		u32 steps[TEVS_BRACKET_MAX_STEPS][2];
+		u32 count;
+		u32 next;
+		bool active;
+		struct {
+			u32 sequence;
+			s32 step;
+		} history[TEVS_BRACKET_HISTORY];
+		s32 index;
+	} bracket;
+
+	/* Digital pan/tilt/zoom viewport, driver copy of the ISP state */
+	struct {
+		u16 pos[TEVS_EPTZ_AXES];
+		u16 start[TEVS_EPTZ_AXES];
+		u16 target[TEVS_EPTZ_AXES];
+		u32 frames;
+		u32 frame;
+		bool moving;
+	} eptz;
+
+	/* Set while the control values are replayed at stream start */
+	bool ctrl_replay;
+	/* Set while a preset is applied, plain registers go out in one burst */
+	bool ctrl_bulk;
+
+	/* Control registers as the ISP powers on, dirty once written since */
+	struct {
+		u8 image[TEVS_CTRL_IMAGE_SIZE];
+		DECLARE_BITMAP(dirty, TEVS_CTRL_IMAGE_SIZE);
+		bool valid;
+	} boot;
+
+	/* Failed I2C transfers in a row, protected by tevs->i2c_lock */
+	u32 i2c_errors;
+
+	/* Stream health watchdog, running while streaming */
+	struct {
+		bool enabled;
+		u32 recoveries;
+		struct delayed_work work;
+	} watchdog;
+
+	/* debugfs, the sensor_regs results are protected by tevs->mutex */
+	struct dentry *debugfs;
+	char *sensor_result;
+	size_t sensor_result_len;
+
+	/* Sensor test pattern, TEVS_TEST_PATTERN_* */
+	u32 test_pattern;
+
+	/* Control presets, protected by tevs->mutex */
+	struct tevs_preset presets[TEVS_PRESET_SLOTS];
+
+	/* HDR readout requested, used by modes that support it */
+	bool hdr;
+
+	/* Requested frame rate, 0 for the maximum of the selected mode */
+	u16 fps;
+
+	/* AE may lower the frame rate (V4L2_CID_EXPOSURE_AUTO_PRIORITY) */
+	bool ae_priority;
+	/* Upper bound of the AE exposure time in us, 0 if unset */
+	u32 ae_max_exposure;
+
+	/* CSI-2 output throughput cap in Mbit/s, 0 for the full link rate */
+	u32 throughput;
+
+	/* Shortest-latency ISP configuration selected */
+	bool low_latency;
+
+	/* Multi-camera sync, membership is protected by tevs_sync_lock */
+	struct list_head sync_entry;
+	u32 sync_group;
+	int sync_role;
+	bool sync_armed;
+	bool sync_pending;
+	struct work_struct sync_work;
+
+	/* Kernel trigger generator, running while trigger_timer is set */
+	struct tevs_trigger_timer *trigger_timer;
+	struct list_head trigger_entry;
+	u32 trigger_period;
+	u32 trigger_pulse;
+	u32 trigger_count;
+	u32 trigger_group;
+	u32 trigger_sequence;
+	u32 trigger_missed;
+	/* Set while tevs_trigger_work() pulses the camera */
+	bool trigger_pulsing;
+
+	/* Strobe on FLASH_OUT, timed from SHUTTER when it can interrupt */
+	int shutter_irq;
+	u32 flash_led_mode;
+	u32 strobe_source;
+	u32 strobe_mode;
+	u32 strobe_interval;
+	u32 strobe_duration;
+	atomic_t strobe_frames;
+	bool strobe_on;
+	struct work_struct strobe_work;
+
+	/* AE state of the last stream, seeds the next one */
+	struct {
+		bool enabled;
+		bool valid;
+		/* AE runs manual on the seed until the first frame work */
+		bool held;
+		u32 exposure;
+		u16 gain;
+	} seed;
+
+	/* AE convergence detector, runs while AE is in auto mode */
+	struct {
+		bool active;
+		bool converged;
+		u32 stable;
+		u32 frames;
+		u32 exposure;
+		u16 gain;
+	} converge;
+
+	/*
+	 * Still burst, preview_mode is restored after frames frames. Mode
+	 * switches into and out of the burst are queued to work as enter and
+	 * leave.
+	 */
+	struct {
+		u8 mode;
+		u8 preview_mode;
+		u32 frames;
+		u32 start;
+		u32 exposure;
+		u16 gain;
+		bool active;
+		bool enter;
+		bool leave;
+		struct work_struct work;
+	} still;
+
+	/* Control writes waiting for cmdq.work, one slot per control */
+	struct {
+		bool enabled;
+		u32 depth;
+		struct v4l2_ctrl *ctrls[TEVS_CMDQ_DEPTH];
+		u32 stats[TEVS_CMDQ_STATS];
+		struct delayed_work work;
+	} cmdq;
+
+	/* Asynchronous stream start/stop, at most one transition in flight */
+	bool stream_async;
+	bool stream_async_on;
+	ktime_t stream_request;
+	struct work_struct stream_work;
+
+	struct v4l2_ctrl *exposure_ctrl;
+	struct v4l2_ctrl *gain_ctrl;
+	struct v4l2_ctrl *exposure_auto_ctrl;
+	struct v4l2_ctrl *flicker_ctrl;
+	struct v4l2_ctrl *denoise_ctrl;
+	struct v4l2_ctrl *sharpen_ctrl;
+	struct v4l2_ctrl *colorfx_ctrl;
+	struct v4l2_ctrl *pan_ctrl;
+	struct v4l2_ctrl *zoom_ctrl;
 };
 
 static const struct regmap_config tevs_regmap_config = {
 	.reg_bits = 16,
 	.val_bits = 8,
 	.cache_type = REGCACHE_NONE,
+	/* Serialised by tevs->i2c_lock */
+	.disable_locking = true,
 };
 
+/* Unlocked transfers, for sequences that must not be split up */
+static int __tevs_i2c_read(struct tevs *tevs, u16 reg, u8 *val, u16 size)
+{
+	int ret;
+
+	lockdep_assert_held(&tevs->i2c_lock);
+	ret = regmap_bulk_read(tevs->regmap, reg, val, size);
+	tevs->i2c_errors = ret < 0 ? tevs->i2c_errors + 1 : 0;
+
+	return ret;
+}
+
+static int __tevs_i2c_write(struct tevs *tevs, u16 reg, u8 *val, u16 size)
+{
+	unsigned int start, end;
+	int ret;
+
+	lockdep_assert_held(&tevs->i2c_lock);
+	/* A failed write leaves the registers unknown as well */
+	start = max_t(unsigned int, reg, TEVS_CTRL_IMAGE_BASE);
+	end = min_t(unsigned int, reg + size,
+		    TEVS_CTRL_IMAGE_BASE + TEVS_CTRL_IMAGE_SIZE);
+	if (start < end)
+		bitmap_set(tevs->boot.dirty, start - TEVS_CTRL_IMAGE_BASE,
+			   end - start);
+	ret = regmap_bulk_write(tevs->regmap, reg, val, size);
+	tevs->i2c_errors = ret < 0 ? tevs->i2c_errors + 1 : 0;
+
+	return ret;
+}
+
 int tevs_i2c_read(struct tevs *tevs, u16 reg, u8 *val, u16 size)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
 	int ret;
 
-	ret = regmap_bulk_read(tevs->regmap, reg, val, size);
+	mutex_lock(&tevs->i2c_lock);
+	ret = __tevs_i2c_read(tevs, reg, val, size);
+	mutex_unlock(&tevs->i2c_lock);
 	if (ret < 0) {
 		dev_err(&client->dev, "Failed to read from register: ret=%d, reg=0x%x\n", ret, reg);
 		return ret;
@@ -373,7 +860,9 @@ int tevs_i2c_write(struct tevs *tevs, u16 reg, u8 *val, u16 size)
 	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
 	int ret;
 
-	ret = regmap_bulk_write(tevs->regmap, reg, val, size);
+	mutex_lock(&tevs->i2c_lock);
+	ret = __tevs_i2c_write(tevs, reg, val, size);
+	mutex_unlock(&tevs->i2c_lock);
 	if (ret < 0) {
 		dev_err(&client->dev, "Failed to write to register: ret=%d reg=0x%x\n", ret, reg);
 		return ret;
@@ -390,12 +879,9 @@ int tevs_i2c_write_16b(struct tevs *tevs, u16 reg, u16 val)
 	data[0] = val >> 8;
 	data[1] = val & 0xFF;
 
-	ret = regmap_bulk_write(tevs->regmap, reg, data, 2);
-	if (ret < 0) {
-		dev_err(&client->dev, 
-			"Failed to write to register: ret=%d reg=0x%x\n", ret, reg);
+	ret = tevs_i2c_write(tevs, reg, data, 2);
+	if (ret < 0)
 		return ret;
-	}
 	dev_dbg(&client->dev, 
 		"%s() write reg 0x%x, value 0x%x\n", 
 		__func__, reg, val);
@@ -403,6 +889,41 @@ int tevs_i2c_write_16b(struct tevs *tevs, u16 reg, u16 val)
 	return 0;
 }
 
+/*
+ * Indirect access to the image sensor behind the ISP. The sensor register
+ * address goes to I2C_ADDR, its value is then read from or written to
+ * I2C_DATA. Called with i2c_lock held so the pair is not split up.
+ */
+static int tevs_sensor_read(struct tevs *tevs, u16 addr, u16 *val)
+{
+	u8 data[2];
+	int ret;
+
+	put_unaligned_be16(addr, data);
+	ret = __tevs_i2c_write(tevs, HOST_COMMAND_ISP_CTRL_I2C_ADDR, data, 2);
+	if (ret)
+		return ret;
+
+	ret = __tevs_i2c_read(tevs, HOST_COMMAND_ISP_CTRL_I2C_DATA, data, 2);
+	if (ret)
+		return ret;
+
+	*val = get_unaligned_be16(data);
+
+	return 0;
+}
+
+static int tevs_sensor_write(struct tevs *tevs, u16 addr, u16 val)
+{
+	u8 data[4];
+
+	/* I2C_ADDR and I2C_DATA are adjacent, one transfer sets both */
+	put_unaligned_be16(addr, &data[0]);
+	put_unaligned_be16(val, &data[2]);
+
+	return __tevs_i2c_write(tevs, HOST_COMMAND_ISP_CTRL_I2C_ADDR, data, 4);
+}
+
 int tevs_enable_trigger_mode(struct tevs *tevs, int enable)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
@@ -415,15 +936,17 @@ int tevs_enable_trigger_mode(struct tevs *tevs, int enable)
 	if((ret = tevs_i2c_write_16b(tevs, TEVS_TRIGGER_CTRL, trigger_data)) < 0)
 		return ret;
 
+	/* The ISP clears the request bits once the new mode is in effect */
 	do {
 		if((ret = tevs_i2c_read_16b(tevs, TEVS_TRIGGER_CTRL, &val)) < 0)
 				return ret;
 		if((val & 0x300) == 0)
-			break;
+			return 0;
 
-	} while(count++ < 10);
+		usleep_range(1000, 2000);
+	} while(count++ < TEVS_TRIGGER_ACK_TIMEOUT);
 
-	usleep_range(90000, 100000);
+	dev_warn(&client->dev, "trigger mode not acknowledged: 0x%x\n", val);
 
 	return ret;
 }
@@ -481,12 +1004,18 @@ int tevs_load_header_info(struct tevs *tevs)
 	}
 }
 
+/* A sync slave takes its exposures from the master through EXPOSURE_TRIG_IN */
+static bool tevs_trigger_enabled(struct tevs *tevs)
+{
+	return tevs->trigger_mode || tevs->sync_role == TEVS_SYNC_ROLE_SLAVE;
+}
+
 int tevs_init_setting(struct tevs *tevs)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
 	int ret = 0;
 
-	if(tevs->trigger_mode) {
+	if(tevs_trigger_enabled(tevs)) {
 		ret = tevs_enable_trigger_mode(tevs, 1);
 		if (ret != 0) {
 			dev_err(&client->dev, "set trigger mode failed\n");
@@ -496,7 +1025,7 @@ int tevs_init_setting(struct tevs *tevs)
 
 	ret += tevs_i2c_write_16b(tevs,
 				HOST_COMMAND_ISP_CTRL_PREVIEW_FORMAT,
-				0x50);
+				TEVS_PREVIEW_FORMAT_UYVY);
 	ret += tevs_i2c_write_16b(tevs,
 				HOST_COMMAND_ISP_CTRL_PREVIEW_HINF_CTRL,
 				0x10 | (tevs->continuous_clock << 5) | (tevs->data_lanes));
@@ -570,894 +1099,3162 @@ static int tevs_check_boot_state(struct tevs *tevs)
 	return ret;
 }
 
-static int tevs_start_streaming(struct tevs *tevs)
+static bool tevs_sensor_has_hdr(struct tevs *tevs)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
-	int ret = 0;
+	return tevs_sensor_table[tevs->selected_sensor].hdr_exposures;
+}
 
-	ret = pm_runtime_get_sync(&client->dev);
-	if (ret < 0) {
-		pm_runtime_put_noidle(&client->dev);
-		return ret;
-	}
+static bool tevs_hdr_active(struct tevs *tevs)
+{
+	return tevs->hdr && tevs_sensor_has_hdr(tevs);
+}
 
-	if(!(tevs->hw_reset_mode | tevs->trigger_mode))
-        ret = tevs_standby(tevs, 0);
-    if (ret == 0) {
-        int fps = tevs_sensor_table[tevs->selected_sensor]
-                    .res_list[tevs->selected_mode]
-                    .framerates;
-        dev_dbg(&client->dev, "%s() width=%d, height=%d\n",
-            __func__,
-            tevs_sensor_table[tevs->selected_sensor]
-                .res_list[tevs->selected_mode]
-                .width,
-            tevs_sensor_table[tevs->selected_sensor]
-                .res_list[tevs->selected_mode]
-                .height);
-        tevs_i2c_write_16b(
-            tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_SENSOR_MODE,
-            tevs_sensor_table[tevs->selected_sensor]
-                .res_list[tevs->selected_mode]
-                .mode);
-        tevs_i2c_write_16b(
-            tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_WIDTH,
-            tevs_sensor_table[tevs->selected_sensor]
-                .res_list[tevs->selected_mode]
-                .width);
-        tevs_i2c_write_16b(
-            tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_HEIGHT,
-            tevs_sensor_table[tevs->selected_sensor]
-                .res_list[tevs->selected_mode]
-                .height);
-        tevs_i2c_write_16b(
-            tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
-            fps);
-    }
-	/* Apply customized values from user */
-	ret =  __v4l2_ctrl_handler_setup(tevs->v4l2_subdev.ctrl_handler);
-	if (ret)
-		goto err_rpm_put;
+/*
+ * Maximum frame rate of a mode, taking the HDR readout into account. The
+ * interleaved HDR readout reads every exposure of an output frame at the
+ * linear readout speed, so the linear rate is divided by the number of
+ * exposures.
+ */
+static u16 tevs_mode_framerate(struct tevs *tevs, int mode)
+{
+	const struct sensor_info *info = &tevs_sensor_table[tevs->selected_sensor];
+	u16 fps = info->res_list[mode].framerates;
 
-	return 0;
+	if (tevs_hdr_active(tevs))
+		return max_t(u16, fps / info->hdr_exposures, 1);
 
-err_rpm_put:
-	pm_runtime_put(&client->dev);
-	return ret;
+	return fps;
 }
 
-static void tevs_stop_streaming(struct tevs *tevs)
+/* Frame rate the selected mode actually runs at */
+static u16 tevs_frame_rate(struct tevs *tevs)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
-	int ret = 0;
+	u16 max = tevs_mode_framerate(tevs, tevs->selected_mode);
 
-	/* set stream off register */
-    if (!(tevs->hw_reset_mode | tevs->trigger_mode)) {
-        ret = tevs_standby(tevs, 1);
-        if (ret)
-            dev_err(&client->dev, "%s failed to set stream\n", __func__);
-    }
+	if (tevs->fps == 0 || tevs->fps > max)
+		return max;
 
-	pm_runtime_put(&client->dev);
+	return tevs->fps;
 }
 
-static int tevs_set_stream(struct v4l2_subdev *sub_dev, int enable)
+/* CSI-2 bandwidth in Mbit/s the selected mode needs at a frame rate */
+static u32 tevs_mode_bandwidth(struct tevs *tevs, u16 fps)
 {
-	struct tevs *tevs = to_tevs(sub_dev);
-	int ret = 0;
+	const struct resolution *res =
+		&tevs_sensor_table[tevs->selected_sensor]
+			 .res_list[tevs->selected_mode];
+	u64 bits = (u64)res->width * res->height * fps * TEVS_BITS_PER_PIXEL;
 
-	dev_dbg(sub_dev->dev, "%s() enable [%x]\n", __func__, enable);
+	return DIV_ROUND_UP_ULL(bits, 1000000);
+}
 
-	mutex_lock(&tevs->mutex);
-	if (tevs->streaming == enable) {
-		mutex_unlock(&tevs->mutex);
-		return 0;
-	}
+/* Highest frame rate of the selected mode the throughput cap allows */
+static u16 tevs_throughput_framerate(struct tevs *tevs)
+{
+	u16 max = tevs_mode_framerate(tevs, tevs->selected_mode);
+	u16 fps = max;
 
-	if (tevs->selected_mode >=
-	    tevs_sensor_table[tevs->selected_sensor].res_list_size)
-		return -EINVAL;
+	if (tevs->throughput == 0)
+		return max;
 
-	if (enable == 0) {
-        tevs_stop_streaming(tevs);
-	} else {		
-		ret = tevs_start_streaming(tevs);
-		if (ret)
-			goto err_unlock;
-	}
-	tevs->streaming = enable;
+	while (fps > 1 && tevs_mode_bandwidth(tevs, fps) > tevs->throughput)
+		fps--;
 
-err_unlock:
-	mutex_unlock(&tevs->mutex);
+	return fps;
+}
 
-	return ret;
+/*
+ * Pixel rate on the CSI-2 link. The module bursts lines out at the link
+ * rate, or at the programmed throughput when that is lower.
+ */
+static s64 tevs_pixel_rate(struct tevs *tevs)
+{
+	u32 lanes = tevs->data_lanes ? tevs->data_lanes : 2;
+	u32 lane_rate = tevs->data_frequency ? tevs->data_frequency :
+			tevs->header_info->mipi_datarate;
+	u32 link = lane_rate * lanes;
+
+	if (tevs->throughput && tevs->throughput < link)
+		link = tevs->throughput;
+
+	return div_u64((u64)link * 1000000, TEVS_BITS_PER_PIXEL);
 }
 
-static int tevs_power_on(struct device *dev)
+/*
+ * Longest exposure AE may use in us, 0 to leave it to the firmware. Without
+ * exposure priority the exposure is capped to the frame interval, so the
+ * frame rate holds and AE raises the gain instead.
+ */
+static u32 tevs_ae_exposure_limit(struct tevs *tevs)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
-	struct tevs *tevs = to_tevs(sub_dev);
-	int ret = 0;
+	u32 limit = tevs->ae_max_exposure;
+	u32 interval;
 
-	dev_dbg(&client->dev, "%s()\n", __func__);
+	if (tevs->ae_priority)
+		return limit;
 
-	ret = regulator_bulk_enable(TEVS_NUM_SUPPLIES, tevs->supplies);
-	if (ret) {
-		dev_err(&client->dev, "%s: failed to enable regulators\n",
-			__func__);
-		return ret;
-	}
+	interval = USEC_PER_SEC / tevs_frame_rate(tevs);
 
-	// gpiod_set_value_cansleep(tevs->standby_gpio, 0);
-	gpiod_set_value_cansleep(tevs->reset_gpio, 1);
-	msleep(TEVS_BOOT_TIME);
+	return limit ? min(limit, interval) : interval;
+}
 
-	ret = tevs_check_boot_state(tevs);
-	if(ret != 0) {
-		goto error;
+/*
+ * TEVS_FLICK_CTRL carries the anti-flicker mode, the frame rate control
+ * bits and the HDR enable, so it is always rebuilt from all of them.
+ */
+static int tevs_flick_ctrl_write(struct tevs *tevs, s32 flick_mode)
+{
+	u16 val;
+
+	switch (flick_mode) {
+	case 1:
+		val = TEVS_FLICK_CTRL_MODE_50HZ;
+		break;
+	case 2:
+		val = TEVS_FLICK_CTRL_MODE_60HZ;
+		break;
+	case 3:
+		val = TEVS_FLICK_CTRL_MODE_AUTO |
+		      TEVS_FLICK_CTRL_FRC_OVERRIDE_UPPER_ET |
+		      TEVS_FLICK_CTRL_FRC_EN;
+		break;
+	case 0:
+	default:
+		val = TEVS_FLICK_CTRL_MODE_DISABLED;
+		break;
 	}
 
-    ret = tevs_init_setting(tevs);
-    if (ret != 0) {
-        dev_err(&client->dev, "init setting failed\n");
-        goto error;
-    }
+	if (tevs_ae_exposure_limit(tevs))
+		val |= TEVS_FLICK_CTRL_FRC_EN |
+		       TEVS_FLICK_CTRL_FRC_OVERRIDE_UPPER_ET |
+		       TEVS_FLICK_CTRL_FRC_OVERRIDE_MAX_ET;
 
-	return ret;
+	if (tevs_hdr_active(tevs))
+		val |= TEVS_FLICK_CTRL_ETC_IHDR_UP;
 
-error:
-	gpiod_set_value_cansleep(tevs->reset_gpio, 0);
-	regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
-	return ret;
+	return tevs_i2c_write_16b(tevs, TEVS_FLICK_CTRL, val);
 }
 
-static int tevs_power_off(struct device *dev)
+static int tevs_ae_limit_apply(struct tevs *tevs)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
-	struct tevs *tevs = to_tevs(sub_dev);
-
-	dev_dbg(&client->dev, "%s()\n", __func__);
+	u32 limit = tevs_ae_exposure_limit(tevs);
+	u8 data[8];
+	int ret;
 
-    gpiod_set_value_cansleep(tevs->reset_gpio, 0);
-    regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
+	if (limit) {
+		/* EXP_TIME_UPPER and EXP_TIME_MAX are adjacent */
+		put_unaligned_be32(limit, &data[0]);
+		put_unaligned_be32(limit, &data[4]);
+		ret = tevs_i2c_write(tevs,
+				     HOST_COMMAND_ISP_CTRL_PREVIEW_EXP_TIME_UPPER_MSB,
+				     data, sizeof(data));
+		if (ret)
+			return ret;
+	}
 
-	return 0;
+	return tevs_flick_ctrl_write(tevs, tevs->flicker_ctrl->cur.val);
 }
 
-static int __maybe_unused tevs_suspend(struct device *dev)
+/* -----------------------------------------------------------------------------
+ * Frame timing and exposure bracketing
+ */
+static int tevs_write_exposure(struct tevs *tevs, u32 exposure)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
-	struct tevs *tevs = to_tevs(sub_dev);
+	u8 exp[4];
+	__be32 exp_temp;
 
-	dev_dbg(&client->dev, "%s()\n", __func__);
+	exp_temp = cpu_to_be32(exposure);
+	memcpy(exp, &exp_temp, 4);
 
-	if (tevs->streaming)
-		tevs_stop_streaming(tevs);
+	return tevs_i2c_write(tevs, TEVS_AE_MANUAL_EXP_TIME, exp, 4);
+}
 
-	return 0;
+/* Restores the exposure requested through the regular controls */
+static void tevs_ae_restore(struct tevs *tevs)
+{
+	tevs_write_exposure(tevs, tevs->exposure_ctrl->cur.val);
+	tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+			   tevs->gain_ctrl->cur.val & TEVS_AE_MANUAL_GAIN_MASK);
+	tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE,
+			   tevs->exposure_auto_ctrl->cur.val ?
+			   TEVS_AE_CTRL_FULL_AUTO :
+			   TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN);
 }
 
-static int __maybe_unused tevs_resume(struct device *dev)
+static int tevs_bracket_apply(struct tevs *tevs, u32 step)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
-	struct tevs *tevs = to_tevs(sub_dev);
+	u32 exposure, gain;
 	int ret;
 
-	dev_dbg(&client->dev, "%s()\n", __func__);
-
-	if (tevs->streaming) {
-		ret = tevs_start_streaming(tevs);
-		if (ret)
-			goto error;
-	}
+	exposure = clamp_t(u32, tevs->bracket.steps[step][TEVS_BRACKET_STEP_EXP],
+			   tevs->exposure_ctrl->minimum,
+			   tevs->exposure_ctrl->maximum);
+	gain = clamp_t(u32, tevs->bracket.steps[step][TEVS_BRACKET_STEP_GAIN],
+		       tevs->gain_ctrl->minimum, tevs->gain_ctrl->maximum);
 
-	return 0;
+	ret = tevs_write_exposure(tevs, exposure);
+	if (ret)
+		return ret;
 
-error:
-	tevs_stop_streaming(tevs);
-	tevs->streaming = false;
+	return tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+				  gain & TEVS_AE_MANUAL_GAIN_MASK);
+}
 
-	return ret;
+/*
+ * True when frame starts come from the FRAME_SYNC line, by interrupt or
+ * polled. Otherwise frame_timer derives them from the nominal frame period,
+ * which is not locked to the sensor and drifts against the real frames.
+ */
+static bool tevs_frames_synced(struct tevs *tevs)
+{
+	return tevs->frame_sync_gpio;
 }
 
-static int tevs_get_regulators(struct tevs *tevs)
+/*
+ * Called once per frame start with the sequence number of the frame that
+ * has just started. Reports the step that frame was exposed with and
+ * programs the next one, which the ISP picks up TEVS_BRACKET_LATENCY frames
+ * later. Without FRAME_SYNC the steps still cycle, but the frame a step
+ * lands on is not known and the index is reported as -1.
+ */
+static void tevs_bracket_advance(struct tevs *tevs, u32 sequence)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
-	unsigned int i;
+	struct v4l2_event ev = { .type = TEVS_EVENT_BRACKET };
+	struct tevs_event_bracket *data = (struct tevs_event_bracket *)ev.u.data;
+	u32 slot = sequence % TEVS_BRACKET_HISTORY;
+	s32 index = -1;
+	u32 step;
+
+	if (!tevs->bracket.active)
+		return;
+
+	if (tevs_frames_synced(tevs) &&
+	    tevs->bracket.history[slot].sequence == sequence)
+		index = tevs->bracket.history[slot].step;
+	tevs->bracket.index = index;
+
+	data->sequence = sequence;
+	data->index = index;
+	if (index >= 0) {
+		data->exposure = tevs->bracket.steps[index][TEVS_BRACKET_STEP_EXP];
+		data->gain = tevs->bracket.steps[index][TEVS_BRACKET_STEP_GAIN];
+	}
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
 
-	for (i = 0; i < TEVS_NUM_SUPPLIES; i++)
-		tevs->supplies[i].supply = tevs_supply_name[i];
+	step = tevs->bracket.next;
+	if (tevs_bracket_apply(tevs, step))
+		return;
 
-	return devm_regulator_bulk_get(&client->dev,
-				       TEVS_NUM_SUPPLIES,
-				       tevs->supplies);
+	slot = (sequence + TEVS_BRACKET_LATENCY) % TEVS_BRACKET_HISTORY;
+	tevs->bracket.history[slot].sequence = sequence + TEVS_BRACKET_LATENCY;
+	tevs->bracket.history[slot].step = step;
+	tevs->bracket.next = (step + 1) % tevs->bracket.count;
 }
 
-static int tevs_get_frame_interval(struct v4l2_subdev *sub_dev,
-				  struct v4l2_subdev_frame_interval *fi)
+static int tevs_bracket_start(struct tevs *tevs)
 {
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int i, ret;
 
-	if (fi->pad != 0)
-		return -EINVAL;
+	if (tevs->bracket.active || tevs->bracket.count == 0)
+		return 0;
 
-	fi->interval.numerator = 1;
-	fi->interval.denominator = 30;
+	dev_dbg(&client->dev, "%s() steps [%d]\n", __func__,
+		tevs->bracket.count);
+
+	for (i = 0; i < TEVS_BRACKET_HISTORY; i++)
+		tevs->bracket.history[i].step = -1;
+	tevs->bracket.next = 0;
+	tevs->bracket.index = -1;
+
+	/* Bracketing drives exposure and gain itself */
+	ret = tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE,
+				 TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN);
+	if (ret)
+		return ret;
+
+	tevs->bracket.active = true;
+	tevs_bracket_advance(tevs, atomic_read(&tevs->frame_sequence));
 
 	return 0;
 }
 
-static int tevs_set_frame_interval(struct v4l2_subdev *sub_dev,
-				  struct v4l2_subdev_frame_interval *fi)
+static void tevs_bracket_stop(struct tevs *tevs)
 {
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	if (!tevs->bracket.active)
+		return;
 
-	if (fi->pad != 0)
-		return -EINVAL;
+	tevs->bracket.active = false;
+	tevs->bracket.index = -1;
+	tevs_ae_restore(tevs);
+}
 
-	fi->interval.numerator = 1;
-	fi->interval.denominator = 30;
+/*
+ * Zoom factor, then the viewport centre. The zoom limits sit between the
+ * two, so they take a transfer each.
+ */
+static int tevs_eptz_write(struct tevs *tevs, const u16 *pos)
+{
+	u8 data[4];
+	int ret;
 
-	return 0;
+	ret = tevs_i2c_write_16b(tevs, TEVS_DZ_TGT_FCT, pos[TEVS_EPTZ_ZOOM]);
+	if (ret)
+		return ret;
+
+	put_unaligned_be16(pos[TEVS_EPTZ_PAN], &data[0]);
+	put_unaligned_be16(pos[TEVS_EPTZ_TILT], &data[2]);
+
+	return tevs_i2c_write(tevs, TEVS_DZ_CT_X, data, sizeof(data));
 }
 
-static int tevs_enum_mbus_code(struct v4l2_subdev *sub_dev,
-			   	  struct v4l2_subdev_state *sub_state,
-			      struct v4l2_subdev_mbus_code_enum *code)
+static int tevs_eptz_set(struct tevs *tevs, const u32 *target)
 {
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
-	if (code->pad || code->index > 0)
-		return -EINVAL;
+	int i;
 
-	code->code = MEDIA_BUS_FMT_UYVY8_2X8;
+	tevs->eptz.target[TEVS_EPTZ_PAN] =
+		clamp_t(u32, target[TEVS_EPTZ_PAN], tevs->pan_ctrl->minimum,
+			tevs->pan_ctrl->maximum);
+	tevs->eptz.target[TEVS_EPTZ_TILT] =
+		clamp_t(u32, target[TEVS_EPTZ_TILT], tevs->pan_ctrl->minimum,
+			tevs->pan_ctrl->maximum);
+	tevs->eptz.target[TEVS_EPTZ_ZOOM] =
+		clamp_t(u32, target[TEVS_EPTZ_ZOOM], tevs->zoom_ctrl->minimum,
+			tevs->zoom_ctrl->maximum);
+
+	/* Without a trajectory, or while idle, jump straight to the target */
+	if (tevs->eptz.frames == 0 || !tevs->streaming) {
+		tevs->eptz.moving = false;
+		memcpy(tevs->eptz.pos, tevs->eptz.target, sizeof(tevs->eptz.pos));
+		return tevs_eptz_write(tevs, tevs->eptz.pos);
+	}
+
+	/* A new target restarts the trajectory from the current viewport */
+	for (i = 0; i < TEVS_EPTZ_AXES; i++)
+		tevs->eptz.start[i] = tevs->eptz.pos[i];
+	tevs->eptz.frame = 0;
+	WRITE_ONCE(tevs->eptz.moving, true);
 
 	return 0;
 }
 
-static int tevs_get_fmt(struct v4l2_subdev *sub_dev,
+/* Moves the viewport one frame along the trajectory */
+static void tevs_eptz_advance(struct tevs *tevs)
+{
+	u32 n = tevs->eptz.frames;
+	int i;
+
+	if (!tevs->eptz.moving)
+		return;
+
+	tevs->eptz.frame++;
+	if (tevs->eptz.frame >= n) {
+		memcpy(tevs->eptz.pos, tevs->eptz.target, sizeof(tevs->eptz.pos));
+		WRITE_ONCE(tevs->eptz.moving, false);
+	} else {
+		for (i = 0; i < TEVS_EPTZ_AXES; i++) {
+			s32 delta = tevs->eptz.target[i] - tevs->eptz.start[i];
+
+			tevs->eptz.pos[i] = tevs->eptz.start[i] +
+				delta * (s32)tevs->eptz.frame / (s32)n;
+		}
+	}
+
+	tevs_eptz_write(tevs, tevs->eptz.pos);
+}
+
+static void tevs_converge_start(struct tevs *tevs, bool ae_auto)
+{
+	tevs->converge.active = ae_auto;
+	tevs->converge.converged = !tevs->converge.active;
+	tevs->converge.stable = 0;
+	tevs->converge.frames = 0;
+	tevs->converge.exposure = 0;
+	tevs->converge.gain = 0;
+}
+
+static bool tevs_converge_within(u32 val, u32 prev)
+{
+	u32 diff = val > prev ? val - prev : prev - val;
+
+	return (u64)diff * 100 <= (u64)max(val, prev) *
+		TEVS_CONVERGE_TOLERANCE_PCT;
+}
+
+/*
+ * Compares the exposure and gain the ISP runs with to those of the
+ * previous frame. Convergence is reported once they stay within the
+ * tolerance for TEVS_CONVERGE_FRAMES frames, and again after a scene
+ * change has moved them out of it. AWB is not covered, the ISP does not
+ * report the colour temperature it estimated.
+ */
+static void tevs_converge_advance(struct tevs *tevs, u32 sequence)
+{
+	struct v4l2_event ev = { .type = TEVS_EVENT_AE_CONVERGED };
+	struct tevs_event_ae_converged *data =
+		(struct tevs_event_ae_converged *)ev.u.data;
+	u8 cur[6];
+	u32 exposure;
+	u16 gain;
+	bool stable;
+
+	if (!tevs->converge.active || tevs->bracket.active ||
+	    tevs->still.active)
+		return;
+
+	if (tevs_i2c_read(tevs, HOST_COMMAND_ISP_CTRL_CURRENT_EXP_TIME_MSB,
+			  cur, sizeof(cur)))
+		return;
+
+	exposure = get_unaligned_be32(&cur[0]);
+	gain = get_unaligned_be16(&cur[4]);
+
+	stable = tevs->converge.frames &&
+		 tevs_converge_within(exposure, tevs->converge.exposure) &&
+		 tevs_converge_within(gain, tevs->converge.gain);
+	tevs->converge.exposure = exposure;
+	tevs->converge.gain = gain;
+	tevs->converge.frames++;
+
+	if (!stable) {
+		tevs->converge.stable = 0;
+		if (tevs->converge.converged) {
+			tevs->converge.converged = false;
+			tevs->converge.frames = 1;
+		}
+		return;
+	}
+
+	if (tevs->converge.converged ||
+	    ++tevs->converge.stable < TEVS_CONVERGE_FRAMES)
+		return;
+
+	tevs->converge.converged = true;
+	data->sequence = sequence;
+	data->frames = tevs->converge.frames;
+	data->exposure = exposure;
+	data->gain = gain;
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+}
+
+static void tevs_still_advance(struct tevs *tevs, u32 sequence);
+
+static const u16 tevs_test_pattern_modes[] = {
+	[TEVS_TEST_PATTERN_DISABLED] = 0,
+	[TEVS_TEST_PATTERN_SOLID] = 1,
+	[TEVS_TEST_PATTERN_BARS] = 2,
+	[TEVS_TEST_PATTERN_FADE] = 3,
+	[TEVS_TEST_PATTERN_WALKING_1S] = 256,
+	[TEVS_TEST_PATTERN_COUNTER] = 1,
+};
+
+static int tevs_test_pattern_write(struct tevs *tevs, u32 pattern)
+{
+	int ret;
+
+	mutex_lock(&tevs->i2c_lock);
+	ret = tevs_sensor_write(tevs, AR_TEST_PATTERN_MODE,
+				tevs_test_pattern_modes[pattern]);
+	mutex_unlock(&tevs->i2c_lock);
+
+	return ret;
+}
+
+static int tevs_test_pattern_apply(struct tevs *tevs)
+{
+	return tevs_test_pattern_write(tevs, tevs->test_pattern);
+}
+
+/* The sensor is left with its normal output once the stream stops */
+static void tevs_test_pattern_restore(struct tevs *tevs)
+{
+	if (tevs->test_pattern != TEVS_TEST_PATTERN_DISABLED)
+		tevs_test_pattern_write(tevs, TEVS_TEST_PATTERN_DISABLED);
+}
+
+/*
+ * Steps the solid color of the frame counter pattern through
+ * TEVS_TEST_PATTERN_LEVELS gray levels, a dropped frame shows up as a
+ * skipped level.
+ */
+static void tevs_test_pattern_advance(struct tevs *tevs, u32 sequence)
+{
+	static const u16 regs[] = {
+		AR_TEST_DATA_RED, AR_TEST_DATA_GREENR,
+		AR_TEST_DATA_BLUE, AR_TEST_DATA_GREENB,
+	};
+	/* 12-bit test data */
+	u16 level = (sequence % TEVS_TEST_PATTERN_LEVELS) *
+		    (0x1000 / TEVS_TEST_PATTERN_LEVELS);
+	unsigned int i;
+
+	if (tevs->test_pattern != TEVS_TEST_PATTERN_COUNTER)
+		return;
+
+	mutex_lock(&tevs->i2c_lock);
+	for (i = 0; i < ARRAY_SIZE(regs); i++)
+		if (tevs_sensor_write(tevs, regs[i], level))
+			break;
+	mutex_unlock(&tevs->i2c_lock);
+}
+
+/* Hands AE back to auto mode once a frame was exposed with the seed */
+static void tevs_seed_release(struct tevs *tevs)
+{
+	if (!tevs->seed.held)
+		return;
+
+	WRITE_ONCE(tevs->seed.held, false);
+	tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE, TEVS_AE_CTRL_FULL_AUTO);
+}
+
+/*
+ * Per-frame work. Without FRAME_SYNC it runs on the frame_timer clock, so
+ * ePTZ trajectories, still bursts, convergence timeouts and the counter
+ * test pattern count timer ticks rather than sensor frames, and may be a
+ * frame or more off from what is captured.
+ */
+static void tevs_frame_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, frame_work);
+	u32 sequence;
+
+	mutex_lock(&tevs->mutex);
+	if (tevs->streaming) {
+		sequence = atomic_read(&tevs->frame_sequence);
+		tevs_seed_release(tevs);
+		tevs_bracket_advance(tevs, sequence);
+		tevs_eptz_advance(tevs);
+		tevs_converge_advance(tevs, sequence);
+		tevs_still_advance(tevs, sequence);
+		tevs_test_pattern_advance(tevs, sequence);
+	}
+	mutex_unlock(&tevs->mutex);
+}
+
+/*
+ * The strobe lasts the flash timeout, cut to the exposure time when the
+ * exposure is manual so that the light stays inside the exposure window.
+ */
+static u32 tevs_strobe_duration(struct tevs *tevs)
+{
+	u32 duration = READ_ONCE(tevs->strobe_duration);
+
+	if (tevs->exposure_auto_ctrl->cur.val ==
+	    TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN_IDX &&
+	    tevs->exposure_ctrl->cur.val > 0)
+		duration = min_t(u32, duration, tevs->exposure_ctrl->cur.val);
+
+	return duration;
+}
+
+/* Drives a strobe pulse on FLASH_OUT, software and external strobes alike */
+static void tevs_strobe_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, strobe_work);
+
+	WRITE_ONCE(tevs->strobe_on, true);
+	gpiod_set_value_cansleep(tevs->flash_gpio, 1);
+	fsleep(tevs_strobe_duration(tevs));
+	gpiod_set_value_cansleep(tevs->flash_gpio, 0);
+	WRITE_ONCE(tevs->strobe_on, false);
+}
+
+/*
+ * Fires an externally sourced strobe on an exposure start, or on a
+ * trigger pulse if on_trigger is set. FLASH_OUT sits on the I2C GPIO
+ * expander, so the line is driven from a work item in either case.
+ */
+static void tevs_strobe_kick(struct tevs *tevs, bool on_trigger)
+{
+	u32 mode = READ_ONCE(tevs->strobe_mode);
+
+	if (!tevs->flash_gpio ||
+	    READ_ONCE(tevs->flash_led_mode) != V4L2_FLASH_LED_MODE_FLASH ||
+	    READ_ONCE(tevs->strobe_source) != V4L2_FLASH_STROBE_SOURCE_EXTERNAL)
+		return;
+
+	if (on_trigger != (mode == TEVS_STROBE_MODE_ON_TRIGGER))
+		return;
+	if (mode == TEVS_STROBE_MODE_EVERY_NTH &&
+	    (atomic_inc_return(&tevs->strobe_frames) - 1) %
+	    READ_ONCE(tevs->strobe_interval))
+		return;
+
+	queue_work(system_highpri_wq, &tevs->strobe_work);
+}
+
+/* Applies the LED mode, a torch is lit for as long as the stream runs */
+static void tevs_flash_apply(struct tevs *tevs)
+{
+	if (!tevs->flash_gpio || tevs->strobe_on)
+		return;
+
+	gpiod_set_value_cansleep(tevs->flash_gpio,
+		tevs->streaming &&
+		tevs->flash_led_mode == V4L2_FLASH_LED_MODE_TORCH);
+}
+
+/*
+ * Counts a frame start and runs the per-frame work. Only a start seen on
+ * the FRAME_SYNC line is reported as V4L2_EVENT_FRAME_SYNC, the event
+ * timestamp being taken when it is queued here.
+ */
+static void tevs_frame_start(struct tevs *tevs, bool sync)
+{
+	u32 sequence = atomic_inc_return(&tevs->frame_sequence);
+
+	if (sync) {
+		struct v4l2_event ev = {
+			.type = V4L2_EVENT_FRAME_SYNC,
+			.u.frame_sync.frame_sequence = sequence,
+		};
+
+		WRITE_ONCE(tevs->frame_timestamp, ktime_get());
+		v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+	}
+
+	if (READ_ONCE(tevs->bracket.active) || READ_ONCE(tevs->eptz.moving) ||
+	    READ_ONCE(tevs->converge.active) || READ_ONCE(tevs->still.active) ||
+	    READ_ONCE(tevs->seed.held) ||
+	    READ_ONCE(tevs->test_pattern) == TEVS_TEST_PATTERN_COUNTER)
+		queue_work(system_highpri_wq, &tevs->frame_work);
+
+	if (tevs->shutter_irq <= 0)
+		tevs_strobe_kick(tevs, false);
+}
+
+static irqreturn_t tevs_frame_sync_irq(int irq, void *dev_id)
+{
+	struct tevs *tevs = dev_id;
+
+	if (READ_ONCE(tevs->frame_sync_active))
+		tevs_frame_start(tevs, true);
+
+	return IRQ_HANDLED;
+}
+
+/* Samples FRAME_SYNC over I2C and reports its rising edges */
+static void tevs_frame_sync_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, frame_sync_work);
+	int level = gpiod_get_value_cansleep(tevs->frame_sync_gpio);
+
+	if (level < 0)
+		return;
+
+	if (level && !tevs->frame_sync_level &&
+	    READ_ONCE(tevs->frame_sync_active))
+		tevs_frame_start(tevs, true);
+	tevs->frame_sync_level = level;
+}
+
+/*
+ * Without FRAME_SYNC the frame start is derived from the frame rate of the
+ * selected mode. With a polled FRAME_SYNC line the timer samples it
+ * instead, so timestamps are within frame_sync_poll_us.
+ */
+static enum hrtimer_restart tevs_frame_timer_handler(struct hrtimer *timer)
+{
+	struct tevs *tevs = container_of(timer, struct tevs, frame_timer);
+
+	if (tevs->frame_sync_gpio) {
+		queue_work(system_highpri_wq, &tevs->frame_sync_work);
+		hrtimer_forward_now(timer,
+				    us_to_ktime(tevs->frame_sync_poll_us));
+	} else {
+		tevs_frame_start(tevs, false);
+		hrtimer_forward_now(timer, tevs->frame_period);
+	}
+
+	return HRTIMER_RESTART;
+}
+
+static void tevs_frame_timer_start(struct tevs *tevs)
+{
+	u16 fps = tevs_frame_rate(tevs);
+
+	tevs->frame_period = ns_to_ktime(div_u64(NSEC_PER_SEC, fps));
+	tevs->frame_sync_level = true;
+	WRITE_ONCE(tevs->frame_sync_active, true);
+
+	/* Edges are delivered by tevs_frame_sync_irq */
+	if (tevs->frame_sync_irq > 0)
+		return;
+
+	hrtimer_start(&tevs->frame_timer,
+		      tevs->frame_sync_gpio ?
+		      us_to_ktime(tevs->frame_sync_poll_us) : tevs->frame_period,
+		      HRTIMER_MODE_REL);
+}
+
+static void tevs_frame_timer_stop(struct tevs *tevs)
+{
+	WRITE_ONCE(tevs->frame_sync_active, false);
+	hrtimer_cancel(&tevs->frame_timer);
+	cancel_work_sync(&tevs->frame_sync_work);
+}
+
+/* Reprograms the frame rate of the running mode and the AE limit with it */
+static int tevs_frame_rate_apply(struct tevs *tevs)
+{
+	u16 fps = tevs_frame_rate(tevs);
+	int ret;
+
+	ret = tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_MAX_FPS,
+				 fps);
+	if (ret)
+		return ret;
+
+	tevs->frame_period = ns_to_ktime(div_u64(NSEC_PER_SEC, fps));
+
+	return tevs_ae_limit_apply(tevs);
+}
+
+static int tevs_hdr_apply(struct tevs *tevs)
+{
+	/* The HDR readout changes the frame rate limit of the running mode */
+	if (tevs->streaming)
+		return tevs_frame_rate_apply(tevs);
+
+	return tevs_flick_ctrl_write(tevs, tevs->flicker_ctrl->cur.val);
+}
+
+static const u16 tevs_sfx_modes[] = {
+	TEVS_SFX_MODE_SFX_NORMAL,
+	TEVS_SFX_MODE_SFX_BW,
+	TEVS_SFX_MODE_SFX_GRAYSCALE,
+	TEVS_SFX_MODE_SFX_NEGATIVE,
+	TEVS_SFX_MODE_SFX_SKETCH,
+};
+
+/* Denoise, sharpen, then flip and effect, skipping the limits between */
+static int tevs_latency_profile_apply(struct tevs *tevs)
+{
+	u16 denoise = tevs->denoise_ctrl->cur.val;
+	u16 sharpen = tevs->sharpen_ctrl->cur.val;
+	u16 sfx = tevs_sfx_modes[tevs->colorfx_ctrl->cur.val];
+	u8 data[4];
+	u16 flip;
+	int ret;
+
+	if (tevs->low_latency) {
+		denoise = tevs->denoise_ctrl->minimum;
+		sharpen = tevs->sharpen_ctrl->minimum;
+		sfx = TEVS_SFX_MODE_SFX_NORMAL;
+	}
+
+	ret = tevs_i2c_read_16b(tevs, TEVS_ORIENTATION, &flip);
+	if (ret)
+		return ret;
+
+	ret = tevs_i2c_write_16b(tevs, TEVS_DENOISE, denoise);
+	if (ret)
+		return ret;
+	ret = tevs_i2c_write_16b(tevs, TEVS_SHARPEN, sharpen);
+	if (ret)
+		return ret;
+
+	put_unaligned_be16(flip, &data[0]);
+	put_unaligned_be16(sfx, &data[2]);
+	ret = tevs_i2c_write(tevs, TEVS_ORIENTATION, data, sizeof(data));
+	if (ret)
+		return ret;
+
+	/* Lines leave the module at the full link rate */
+	return tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+				  tevs->low_latency ? 0 : tevs->throughput);
+}
+
+static int tevs_software_trigger(struct tevs *tevs)
+{
+	if (!tevs->trigger_gpio)
+		return -ENODEV;
+	if (!tevs->trigger_mode || !tevs->streaming || tevs->trigger_timer)
+		return -EBUSY;
+
+	gpiod_set_value_cansleep(tevs->trigger_gpio, 1);
+	tevs_strobe_kick(tevs, true);
+	usleep_range(TEVS_TRIGGER_PULSE_US, TEVS_TRIGGER_PULSE_US + 10);
+	gpiod_set_value_cansleep(tevs->trigger_gpio, 0);
+
+	return 0;
+}
+
+static LIST_HEAD(tevs_trigger_timers);
+static DEFINE_MUTEX(tevs_trigger_lock);
+static DECLARE_WAIT_QUEUE_HEAD(tevs_trigger_wq);
+
+static enum hrtimer_restart tevs_trigger_timer_handler(struct hrtimer *timer)
+{
+	struct tevs_trigger_timer *t =
+		container_of(timer, struct tevs_trigger_timer, timer);
+	u64 overruns;
+
+	/* A slot whose pulse has not been driven yet is lost */
+	WRITE_ONCE(t->expires, hrtimer_get_expires(timer));
+	if (!queue_work(system_highpri_wq, &t->work))
+		atomic_inc(&t->missed);
+
+	overruns = hrtimer_forward_now(timer, t->period);
+	if (overruns > 1)
+		atomic_add(overruns - 1, &t->missed);
+
+	if (t->count && ++t->fired >= t->count)
+		return HRTIMER_NORESTART;
+
+	return HRTIMER_RESTART;
+}
+
+static void tevs_trigger_work(struct work_struct *work)
+{
+	struct tevs_trigger_timer *t =
+		container_of(work, struct tevs_trigger_timer, work);
+	struct v4l2_event ev = { .type = TEVS_EVENT_TRIGGER };
+	struct tevs_event_trigger *data = (struct tevs_event_trigger *)ev.u.data;
+	struct tevs *members[TEVS_TRIGGER_MEMBERS_MAX];
+	struct tevs *member;
+	unsigned int i, n = 0;
+	s64 late;
+
+	/*
+	 * The pulse is driven on a copy of the member list, so other groups
+	 * do not wait for it. A member leaving waits for trigger_pulsing.
+	 */
+	mutex_lock(&tevs_trigger_lock);
+	list_for_each_entry(member, &t->members, trigger_entry) {
+		member->trigger_pulsing = true;
+		members[n++] = member;
+	}
+	mutex_unlock(&tevs_trigger_lock);
+
+	late = ktime_us_delta(ktime_get(), READ_ONCE(t->expires));
+	for (i = 0; i < n; i++) {
+		gpiod_set_value_cansleep(members[i]->trigger_gpio, 1);
+		tevs_strobe_kick(members[i], true);
+	}
+	usleep_range(t->pulse, t->pulse + 10);
+	for (i = 0; i < n; i++)
+		gpiod_set_value_cansleep(members[i]->trigger_gpio, 0);
+
+	data->missed = atomic_xchg(&t->missed, 0);
+	data->late = clamp_t(s64, late, 0, U32_MAX);
+	for (i = 0; i < n; i++) {
+		data->sequence = ++members[i]->trigger_sequence;
+		members[i]->trigger_missed += data->missed;
+		if (data->missed || late > TEVS_TRIGGER_LATE_US)
+			v4l2_subdev_notify_event(&members[i]->v4l2_subdev, &ev);
+	}
+
+	mutex_lock(&tevs_trigger_lock);
+	for (i = 0; i < n; i++)
+		members[i]->trigger_pulsing = false;
+	mutex_unlock(&tevs_trigger_lock);
+	wake_up_all(&tevs_trigger_wq);
+}
+
+/*
+ * Joins the timer of the trigger group, or starts a timer of its own. A
+ * group keeps the cadence of the member that started it.
+ */
+static int tevs_trigger_gen_start(struct tevs *tevs)
+{
+	struct tevs_trigger_timer *t = NULL, *it;
+	int ret = 0;
+
+	if (!tevs->trigger_mode || !tevs->trigger_period)
+		return 0;
+	if (!tevs->trigger_gpio)
+		return -ENODEV;
+	if (tevs->trigger_period < TEVS_TRIGGER_PERIOD_MIN ||
+	    tevs->trigger_pulse >= tevs->trigger_period)
+		return -EINVAL;
+
+	tevs->trigger_sequence = 0;
+	tevs->trigger_missed = 0;
+
+	mutex_lock(&tevs_trigger_lock);
+	if (tevs->trigger_group)
+		list_for_each_entry(it, &tevs_trigger_timers, entry)
+			if (it->group == tevs->trigger_group) {
+				t = it;
+				break;
+			}
+
+	if (t) {
+		if (ktime_to_us(t->period) != tevs->trigger_period) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if (t->nr_members >= TEVS_TRIGGER_MEMBERS_MAX) {
+			ret = -EBUSY;
+			goto out;
+		}
+	} else {
+		t = kzalloc(sizeof(*t), GFP_KERNEL);
+		if (!t) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		INIT_LIST_HEAD(&t->members);
+		hrtimer_init(&t->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		t->timer.function = tevs_trigger_timer_handler;
+		INIT_WORK(&t->work, tevs_trigger_work);
+		t->period = us_to_ktime(tevs->trigger_period);
+		t->pulse = tevs->trigger_pulse;
+		t->count = tevs->trigger_count;
+		t->group = tevs->trigger_group;
+		list_add_tail(&t->entry, &tevs_trigger_timers);
+		hrtimer_start(&t->timer, t->period, HRTIMER_MODE_REL);
+	}
+
+	list_add_tail(&tevs->trigger_entry, &t->members);
+	t->nr_members++;
+	tevs->trigger_timer = t;
+out:
+	mutex_unlock(&tevs_trigger_lock);
+
+	return ret;
+}
+
+static void tevs_trigger_gen_stop(struct tevs *tevs)
+{
+	struct tevs_trigger_timer *t = tevs->trigger_timer;
+	bool last;
+
+	if (!t)
+		return;
+
+	mutex_lock(&tevs_trigger_lock);
+	list_del(&tevs->trigger_entry);
+	last = !--t->nr_members;
+	if (last)
+		list_del(&t->entry);
+	mutex_unlock(&tevs_trigger_lock);
+
+	tevs->trigger_timer = NULL;
+	if (last) {
+		hrtimer_cancel(&t->timer);
+		cancel_work_sync(&t->work);
+		kfree(t);
+	} else {
+		/* The group lives on, only a pulse already started uses us */
+		wait_event(tevs_trigger_wq, !READ_ONCE(tevs->trigger_pulsing));
+	}
+}
+
+/*
+ * The SHUTTER line sits on the I2C GPIO expander, so this only runs as a
+ * threaded handler and the timestamp is taken as early as possible.
+ */
+static irqreturn_t tevs_shutter_irq(int irq, void *dev_id)
+{
+	struct tevs *tevs = dev_id;
+	struct v4l2_event ev = { .type = TEVS_EVENT_SHUTTER };
+	struct tevs_event_shutter *data = (struct tevs_event_shutter *)ev.u.data;
+
+	data->timestamp = ktime_get_ns();
+	data->sequence = atomic_inc_return(&tevs->shutter_sequence);
+	tevs_strobe_kick(tevs, false);
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Samples where AE settled, while the ISP still runs. AWB is not seeded,
+ * the ISP does not report the colour temperature it estimated.
+ */
+static void tevs_seed_sample(struct tevs *tevs)
+{
+	u8 cur[6];
+
+	if (!tevs->seed.enabled || tevs->seed.held ||
+	    tevs->exposure_auto_ctrl->cur.val != TEVS_AE_CTRL_FULL_AUTO_IDX)
+		return;
+
+	if (!tevs_i2c_read(tevs, HOST_COMMAND_ISP_CTRL_CURRENT_EXP_TIME_MSB,
+			   cur, sizeof(cur))) {
+		tevs->seed.exposure = get_unaligned_be32(&cur[0]);
+		tevs->seed.gain = get_unaligned_be16(&cur[4]);
+		tevs->seed.valid = tevs->seed.exposure != 0;
+	}
+}
+
+/*
+ * Starts AE from the sampled state. The values are applied in manual
+ * mode, tevs_seed_release() hands AE back to auto mode on the first frame.
+ */
+static int tevs_seed_apply(struct tevs *tevs)
+{
+	int ret;
+
+	if (!tevs->seed.enabled || !tevs->seed.valid ||
+	    tevs->exposure_auto_ctrl->cur.val != TEVS_AE_CTRL_FULL_AUTO_IDX)
+		return 0;
+
+	ret = tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE,
+				 TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN);
+	ret = ret ?: tevs_write_exposure(tevs,
+			clamp_t(u32, tevs->seed.exposure,
+				tevs->exposure_ctrl->minimum,
+				tevs->exposure_ctrl->maximum));
+	ret = ret ?: tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+			tevs->seed.gain & TEVS_AE_MANUAL_GAIN_MASK);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(tevs->seed.held, true);
+
+	return 0;
+}
+
+/* PREVIEW_WIDTH up to PREVIEW_MAX_FPS */
+static int tevs_mode_write(struct tevs *tevs)
+{
+	const struct resolution *res =
+		&tevs_sensor_table[tevs->selected_sensor]
+			 .res_list[tevs->selected_mode];
+	u8 data[12];
+
+	put_unaligned_be16(res->width, &data[0]);
+	put_unaligned_be16(res->height, &data[2]);
+	put_unaligned_be16(TEVS_PREVIEW_FORMAT_UYVY, &data[4]);
+	put_unaligned_be16(res->mode, &data[6]);
+	put_unaligned_be16(tevs->low_latency ? 0 : tevs->throughput, &data[8]);
+	put_unaligned_be16(tevs_frame_rate(tevs), &data[10]);
+
+	return tevs_i2c_write(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_WIDTH, data,
+			      sizeof(data));
+}
+
+static void tevs_snapshot_publish(struct tevs *tevs)
+{
+	write_seqlock(&tevs->snapshot_lock);
+	tevs->snapshot.fmt = tevs->fmt;
+	tevs->snapshot.frame_rate = tevs_frame_rate(tevs);
+	tevs->snapshot.streaming = tevs->streaming;
+	write_sequnlock(&tevs->snapshot_lock);
+}
+
+static void tevs_snapshot_read(struct tevs *tevs, struct tevs_snapshot *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&tevs->snapshot_lock);
+		*snap = tevs->snapshot;
+	} while (read_seqretry(&tevs->snapshot_lock, seq));
+}
+
+static void tevs_mode_fmt(struct tevs *tevs, u8 mode)
+{
+	const struct resolution *res =
+		&tevs_sensor_table[tevs->selected_sensor].res_list[mode];
+
+	tevs->fmt.width = res->width;
+	tevs->fmt.height = res->height;
+	tevs_snapshot_publish(tevs);
+}
+
+static void tevs_stream_set(struct tevs *tevs, bool streaming)
+{
+	tevs->streaming = streaming;
+	tevs_flash_apply(tevs);
+	tevs_snapshot_publish(tevs);
+}
+
+static int tevs_watchdog_apply(struct tevs *tevs)
+{
+	/* Stops by itself once disabled or the stream is off */
+	if (tevs->watchdog.enabled)
+		queue_delayed_work(system_highpri_wq, &tevs->watchdog.work,
+				   msecs_to_jiffies(TEVS_WATCHDOG_PERIOD_MS));
+
+	return 0;
+}
+
+/* Powers the module up and takes the ISP out of standby */
+static int tevs_stream_wake(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	ret = pm_runtime_get_sync(&client->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(&client->dev);
+		return ret;
+	}
+
+	if (tevs->hw_reset_mode || tevs_trigger_enabled(tevs))
+		return 0;
+
+	ret = tevs_standby(tevs, 0);
+	if (ret)
+		pm_runtime_put(&client->dev);
+
+	return ret;
+}
+
+/* Puts the ISP back into standby and drops the power reference */
+static void tevs_stream_sleep(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	/* set stream off register */
+	if (!(tevs->hw_reset_mode | tevs_trigger_enabled(tevs))) {
+		ret = tevs_standby(tevs, 1);
+		if (ret)
+			dev_err(&client->dev, "%s failed to set stream\n",
+				__func__);
+	}
+
+	pm_runtime_put(&client->dev);
+}
+
+static int tevs_ctrls_batch_write(struct tevs *tevs);
+
+/* Programs the mode and the controls of an awake ISP */
+static int tevs_stream_setup(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	dev_dbg(&client->dev, "%s() width=%d, height=%d\n",
+		__func__,
+		tevs_sensor_table[tevs->selected_sensor]
+			.res_list[tevs->selected_mode]
+			.width,
+		tevs_sensor_table[tevs->selected_sensor]
+			.res_list[tevs->selected_mode]
+			.height);
+	ret = tevs_mode_write(tevs);
+	if (ret)
+		return ret;
+
+	/* Apply customized values from user */
+	ret = tevs_ctrls_batch_write(tevs);
+	if (ret)
+		return ret;
+
+	tevs->ctrl_replay = true;
+	ret =  __v4l2_ctrl_handler_setup(tevs->v4l2_subdev.ctrl_handler);
+	tevs->ctrl_replay = false;
+	if (ret)
+		return ret;
+
+	/* The viewport is replayed from the driver copy in one transfer */
+	tevs->eptz.moving = false;
+	ret = tevs_eptz_write(tevs, tevs->eptz.pos);
+	if (ret)
+		return ret;
+
+	ret = tevs_seed_apply(tevs);
+	if (ret)
+		return ret;
+	tevs_converge_start(tevs,
+		tevs->exposure_auto_ctrl->cur.val == TEVS_AE_CTRL_FULL_AUTO_IDX);
+
+	atomic_set(&tevs->shutter_sequence, 0);
+	atomic_set(&tevs->strobe_frames, 0);
+	tevs_frame_timer_start(tevs);
+	ret = tevs_bracket_start(tevs);
+	if (ret) {
+		tevs_frame_timer_stop(tevs);
+		return ret;
+	}
+
+	ret = tevs_trigger_gen_start(tevs);
+	if (ret) {
+		tevs_bracket_stop(tevs);
+		tevs_frame_timer_stop(tevs);
+		return ret;
+	}
+
+	return tevs_watchdog_apply(tevs);
+}
+
+/* Stops the frame machinery and settles the driver state */
+static void tevs_stream_teardown(struct tevs *tevs)
+{
+	tevs_trigger_gen_stop(tevs);
+	tevs_frame_timer_stop(tevs);
+	tevs_bracket_stop(tevs);
+	cancel_work_sync(&tevs->strobe_work);
+	tevs_seed_sample(tevs);
+	/* A stream stopped before its first frame still returns to auto */
+	tevs_seed_release(tevs);
+	tevs_test_pattern_restore(tevs);
+
+	/* An interrupted burst leaves the preview mode selected */
+	tevs->still.enter = false;
+	if (tevs->still.active || tevs->still.leave) {
+		WRITE_ONCE(tevs->still.active, false);
+		tevs->still.leave = false;
+		tevs_mode_fmt(tevs, tevs->still.preview_mode);
+		tevs->selected_mode = tevs->still.preview_mode;
+	}
+
+	/* Finish an interrupted trajectory at its target */
+	if (tevs->eptz.moving) {
+		memcpy(tevs->eptz.pos, tevs->eptz.target, sizeof(tevs->eptz.pos));
+		tevs->eptz.moving = false;
+	}
+}
+
+/*
+ * Starts streaming with stream_lock held and mutex released. Controls and
+ * formats stay available while the ISP wakes up, whatever they change is
+ * picked up by the setup.
+ */
+static int tevs_stream_on(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	ret = tevs_stream_wake(tevs);
+	if (ret)
+		return ret;
+
+	mutex_lock(&tevs->mutex);
+	/* Only a stream start restarts the count, mode switches keep it */
+	atomic_set(&tevs->frame_sequence, 0);
+	ret = tevs_stream_setup(tevs);
+	if (ret)
+		pm_runtime_put(&client->dev);
+	else
+		tevs_stream_set(tevs, true);
+	mutex_unlock(&tevs->mutex);
+
+	return ret;
+}
+
+/* Reports the end of an asynchronous stream start */
+static void tevs_stream_notify(struct tevs *tevs, int error)
+{
+	struct v4l2_event ev = { .type = TEVS_EVENT_STREAM };
+	struct tevs_event_stream *data = (struct tevs_event_stream *)ev.u.data;
+
+	data->error = error;
+	data->sequence = atomic_read(&tevs->frame_sequence) + 1;
+	data->duration = ktime_us_delta(ktime_get(), tevs->stream_request);
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+}
+
+/*
+ * Cameras of a sync group are started slaves first, so that every slave
+ * waits on EXPOSURE_TRIG_IN when the master emits its first FRAME_SYNC.
+ * A master started early fails with -EAGAIN. With Stream_Async set its
+ * start is held until the last slave is armed instead, and reported
+ * through TEVS_EVENT_STREAM. Stopping the master halts the whole group on
+ * the same frame.
+ */
+static LIST_HEAD(tevs_sync_list);
+static DEFINE_MUTEX(tevs_sync_lock);
+
+static const char * const tevs_sync_role_names[] = {
+	"free-run",
+	"master",
+	"slave",
+};
+
+static struct tevs *tevs_sync_master(struct tevs *tevs)
+{
+	struct tevs *member;
+
+	lockdep_assert_held(&tevs_sync_lock);
+
+	list_for_each_entry(member, &tevs_sync_list, sync_entry)
+		if (member->sync_group == tevs->sync_group &&
+		    member->sync_role == TEVS_SYNC_ROLE_MASTER)
+			return member;
+
+	return NULL;
+}
+
+static bool tevs_sync_slaves_armed(struct tevs *master)
+{
+	struct tevs *member;
+
+	lockdep_assert_held(&tevs_sync_lock);
+
+	list_for_each_entry(member, &tevs_sync_list, sync_entry)
+		if (member->sync_group == master->sync_group &&
+		    member->sync_role == TEVS_SYNC_ROLE_SLAVE &&
+		    !member->sync_armed)
+			return false;
+
+	return true;
+}
+
+static int tevs_sync_set_role(struct tevs *tevs, int role)
+{
+	struct tevs *master;
+	int ret = 0;
+
+	mutex_lock(&tevs_sync_lock);
+	master = tevs_sync_master(tevs);
+	if (role == TEVS_SYNC_ROLE_MASTER && master && master != tevs)
+		ret = -EBUSY;
+	else
+		tevs->sync_role = role;
+	mutex_unlock(&tevs_sync_lock);
+
+	return ret;
+}
+
+/* Returns true if a master has to wait for its slaves before starting */
+static bool tevs_sync_hold(struct tevs *tevs)
+{
+	bool hold;
+
+	if (tevs->sync_role != TEVS_SYNC_ROLE_MASTER)
+		return false;
+
+	mutex_lock(&tevs_sync_lock);
+	hold = !tevs_sync_slaves_armed(tevs);
+	tevs->sync_pending = hold;
+	mutex_unlock(&tevs_sync_lock);
+
+	return hold;
+}
+
+/* Drops a held master start, returns true if there was one */
+static bool tevs_sync_cancel(struct tevs *tevs)
+{
+	bool pending;
+
+	mutex_lock(&tevs_sync_lock);
+	pending = tevs->sync_pending;
+	tevs->sync_pending = false;
+	mutex_unlock(&tevs_sync_lock);
+
+	return pending;
+}
+
+static void tevs_sync_arm(struct tevs *tevs, bool armed)
+{
+	struct tevs *master;
+
+	if (tevs->sync_role != TEVS_SYNC_ROLE_SLAVE)
+		return;
+
+	mutex_lock(&tevs_sync_lock);
+	tevs->sync_armed = armed;
+	master = tevs_sync_master(tevs);
+	if (armed && master && master->sync_pending &&
+	    tevs_sync_slaves_armed(master))
+		queue_work(system_highpri_wq, &master->sync_work);
+	mutex_unlock(&tevs_sync_lock);
+}
+
+/* Takes a camera out of its sync group, a held master stops waiting for it */
+static void tevs_sync_leave(struct tevs *tevs)
+{
+	struct tevs *master = NULL;
+
+	mutex_lock(&tevs_sync_lock);
+	list_del(&tevs->sync_entry);
+	if (tevs->sync_role == TEVS_SYNC_ROLE_SLAVE)
+		master = tevs_sync_master(tevs);
+	if (master && master->sync_pending && tevs_sync_slaves_armed(master))
+		queue_work(system_highpri_wq, &master->sync_work);
+	mutex_unlock(&tevs_sync_lock);
+
+	cancel_work_sync(&tevs->sync_work);
+}
+
+static void tevs_sync_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, sync_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	bool start;
+	int ret;
+
+	mutex_lock(&tevs->stream_lock);
+
+	mutex_lock(&tevs_sync_lock);
+	start = tevs->sync_pending && tevs_sync_slaves_armed(tevs);
+	if (start)
+		tevs->sync_pending = false;
+	mutex_unlock(&tevs_sync_lock);
+
+	if (start && !tevs->streaming) {
+		ret = tevs_stream_on(tevs);
+		if (ret)
+			dev_err(&client->dev, "sync group start failed: %d\n",
+				ret);
+		tevs_stream_notify(tevs, ret);
+	}
+
+	mutex_unlock(&tevs->stream_lock);
+}
+
+/*
+ * Offset of the last frame start from the nearest master frame start in
+ * us, 0 when either camera has no FRAME_SYNC line to measure it from.
+ */
+static s32 tevs_sync_skew(struct tevs *tevs)
+{
+	struct tevs *master;
+	s32 period, skew = 0;
+
+	mutex_lock(&tevs_sync_lock);
+	master = tevs_sync_master(tevs);
+	if (master && master != tevs && READ_ONCE(master->streaming) &&
+	    tevs->streaming && master->frame_sync_gpio &&
+	    tevs->frame_sync_gpio) {
+		period = ktime_to_ns(master->frame_period);
+		div_s64_rem(ktime_to_ns(ktime_sub(
+				READ_ONCE(tevs->frame_timestamp),
+				READ_ONCE(master->frame_timestamp))),
+			    period, &skew);
+		if (skew > period / 2)
+			skew -= period;
+		else if (skew < -period / 2)
+			skew += period;
+		skew /= NSEC_PER_USEC;
+	}
+	mutex_unlock(&tevs_sync_lock);
+
+	return skew;
+}
+
+/*
+ * Runs the ISP wake up or standby of an asynchronous STREAMON/STREAMOFF
+ * while the receiver sets itself up. The next transition waits for this
+ * one in tevs_set_stream().
+ */
+static void tevs_stream_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, stream_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	mutex_lock(&tevs->stream_lock);
+	if (!tevs->stream_async_on) {
+		tevs_stream_sleep(tevs);
+		goto out;
+	}
+
+	ret = tevs_stream_on(tevs);
+	if (ret)
+		dev_err(&client->dev, "stream start failed: %d\n", ret);
+	else
+		tevs_sync_arm(tevs, true);
+	tevs_stream_notify(tevs, ret);
+
+out:
+	mutex_unlock(&tevs->stream_lock);
+}
+
+static int tevs_set_stream(struct v4l2_subdev *sub_dev, int enable)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	int ret = 0;
+
+	dev_dbg(sub_dev->dev, "%s() enable [%x]\n", __func__, enable);
+
+	/* A transition still running asynchronously completes first */
+	flush_work(&tevs->stream_work);
+
+	mutex_lock(&tevs->stream_lock);
+	mutex_lock(&tevs->mutex);
+	if ((enable == 0 && tevs_sync_cancel(tevs)) ||
+	    tevs->streaming == enable)
+		goto err_unlock;
+
+	if (tevs->selected_mode >=
+	    tevs_sensor_table[tevs->selected_sensor].res_list_size) {
+		ret = -EINVAL;
+		goto err_unlock;
+	}
+
+	if (enable == 0) {
+		tevs_sync_arm(tevs, false);
+		tevs_stream_teardown(tevs);
+		tevs_stream_set(tevs, false);
+		if (tevs->stream_async) {
+			tevs->stream_async_on = false;
+			queue_work(system_highpri_wq, &tevs->stream_work);
+			goto err_unlock;
+		}
+		mutex_unlock(&tevs->mutex);
+		tevs_stream_sleep(tevs);
+		goto err_unlock_stream;
+	}
+
+	if (tevs_sync_hold(tevs)) {
+		/* Started by tevs_sync_work() once the slaves are armed */
+		if (tevs->stream_async) {
+			tevs->stream_request = ktime_get();
+			goto err_unlock;
+		}
+		/* The receiver must not start on a link that is not running */
+		tevs_sync_cancel(tevs);
+		ret = -EAGAIN;
+		goto err_unlock;
+	}
+
+	if (tevs->stream_async) {
+		/* The outcome is reported through TEVS_EVENT_STREAM */
+		tevs->stream_async_on = true;
+		tevs->stream_request = ktime_get();
+		queue_work(system_highpri_wq, &tevs->stream_work);
+		goto err_unlock;
+	}
+
+	mutex_unlock(&tevs->mutex);
+	ret = tevs_stream_on(tevs);
+	if (!ret)
+		tevs_sync_arm(tevs, true);
+	goto err_unlock_stream;
+
+err_unlock:
+	mutex_unlock(&tevs->mutex);
+err_unlock_stream:
+	mutex_unlock(&tevs->stream_lock);
+
+	return ret;
+}
+
+/*
+ * Takes the ISP through standby into another readout mode. The mutex is
+ * dropped for the standby polls. streaming stays clear meanwhile, so the
+ * controls only note their values and the setup applies them. The
+ * published state keeps showing the stream until the switch is done.
+ */
+static int tevs_mode_restart(struct tevs *tevs, u8 mode)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	/* Keep the module powered across the standby */
+	pm_runtime_get_noresume(&client->dev);
+	tevs_stream_teardown(tevs);
+	tevs->selected_mode = mode;
+	tevs->streaming = false;
+	mutex_unlock(&tevs->mutex);
+
+	tevs_stream_sleep(tevs);
+	ret = tevs_stream_wake(tevs);
+
+	mutex_lock(&tevs->mutex);
+	pm_runtime_put(&client->dev);
+	if (!ret) {
+		ret = tevs_stream_setup(tevs);
+		if (ret)
+			pm_runtime_put(&client->dev);
+	}
+	if (ret) {
+		tevs_sync_arm(tevs, false);
+		tevs_stream_set(tevs, false);
+		return ret;
+	}
+
+	tevs->streaming = true;
+
+	return 0;
+}
+
+/*
+ * Switches the output size while streaming, with stream_lock and mutex
+ * held. Sizes sharing the sensor readout mode only need the preview
+ * registers rewritten, a different readout mode goes through
+ * tevs_mode_restart(). The new format is published and the pipeline told
+ * through V4L2_EVENT_SOURCE_CHANGE once the switch is done.
+ */
+static int tevs_mode_switch(struct tevs *tevs, u8 mode)
+{
+	const struct resolution *res_list =
+		tevs_sensor_table[tevs->selected_sensor].res_list;
+	struct v4l2_event ev = {
+		.type = V4L2_EVENT_SOURCE_CHANGE,
+		.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+	};
+	int ret;
+
+	lockdep_assert_held(&tevs->stream_lock);
+
+	if (res_list[mode].mode == res_list[tevs->selected_mode].mode) {
+		tevs->selected_mode = mode;
+		ret = tevs_mode_write(tevs);
+		if (ret)
+			return ret;
+
+		tevs->frame_period = ns_to_ktime(div_u64(NSEC_PER_SEC,
+							 tevs_frame_rate(tevs)));
+		ret = tevs_ae_limit_apply(tevs);
+	} else {
+		ret = tevs_mode_restart(tevs, mode);
+	}
+	if (ret)
+		return ret;
+
+	tevs_mode_fmt(tevs, mode);
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+
+	return 0;
+}
+
+/*
+ * Carries the preview exposure to the still frames. The gain goes first,
+ * so that AE turns manual together with the exposure time.
+ */
+static int tevs_still_ae_write(struct tevs *tevs)
+{
+	u8 data[6];
+	int ret;
+
+	ret = tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+				 tevs->still.gain & TEVS_AE_MANUAL_GAIN_MASK);
+	if (ret)
+		return ret;
+
+	put_unaligned_be16(TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN, &data[0]);
+	put_unaligned_be32(clamp_t(u32, tevs->still.exposure,
+				   tevs->exposure_ctrl->minimum,
+				   tevs->exposure_ctrl->maximum), &data[2]);
+
+	return tevs_i2c_write(tevs, TEVS_AE_CTRL_MODE, data, sizeof(data));
+}
+
+static bool tevs_still_busy(struct tevs *tevs)
+{
+	return tevs->still.active || tevs->still.enter || tevs->still.leave;
+}
+
+/* Starts the burst frames in the still mode */
+static int tevs_still_begin(struct tevs *tevs)
+{
+	struct v4l2_event ev = { .type = TEVS_EVENT_STILL };
+	struct tevs_event_still *data = (struct tevs_event_still *)ev.u.data;
+	int ret;
+
+	ret = tevs_still_ae_write(tevs);
+	if (ret)
+		return ret;
+
+	tevs->still.start = atomic_read(&tevs->frame_sequence);
+	WRITE_ONCE(tevs->still.active, true);
+
+	data->sequence = tevs->still.start + TEVS_STILL_LATENCY + 1;
+	data->frames = tevs->still.frames;
+	data->width = tevs->fmt.width;
+	data->height = tevs->fmt.height;
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+
+	return 0;
+}
+
+static void tevs_still_end(struct tevs *tevs)
+{
+	tevs_ae_restore(tevs);
+	tevs_converge_start(tevs,
+		tevs->exposure_auto_ctrl->cur.val == TEVS_AE_CTRL_FULL_AUTO_IDX);
+}
+
+static int tevs_still_start(struct tevs *tevs)
+{
+	u8 cur[6];
+	int ret;
+
+	if (!tevs->streaming || tevs_still_busy(tevs) || tevs->bracket.active)
+		return -EBUSY;
+
+	/* Exposure and gain the preview runs with right now */
+	ret = tevs_i2c_read(tevs, HOST_COMMAND_ISP_CTRL_CURRENT_EXP_TIME_MSB,
+			    cur, sizeof(cur));
+	if (ret)
+		return ret;
+
+	tevs->still.exposure = get_unaligned_be32(&cur[0]);
+	tevs->still.gain = get_unaligned_be16(&cur[4]);
+	tevs->still.preview_mode = tevs->selected_mode;
+
+	if (tevs->still.mode == tevs->selected_mode)
+		return tevs_still_begin(tevs);
+
+	/* The switch needs stream_lock, which ranks above the control lock */
+	tevs->still.enter = true;
+	queue_work(system_highpri_wq, &tevs->still.work);
+
+	return 0;
+}
+
+static void tevs_still_advance(struct tevs *tevs, u32 sequence)
+{
+	if (!tevs->still.active ||
+	    sequence - tevs->still.start <
+	    tevs->still.frames + TEVS_STILL_LATENCY)
+		return;
+
+	WRITE_ONCE(tevs->still.active, false);
+	if (tevs->still.preview_mode == tevs->selected_mode) {
+		tevs_still_end(tevs);
+		return;
+	}
+
+	tevs->still.leave = true;
+	queue_work(system_highpri_wq, &tevs->still.work);
+}
+
+/* Runs the mode switches of a burst outside the frame and control paths */
+static void tevs_still_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(work, struct tevs, still.work);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	mutex_lock(&tevs->stream_lock);
+	mutex_lock(&tevs->mutex);
+	/* Both are cleared when the stream stops meanwhile */
+	if (tevs->still.enter) {
+		tevs->still.enter = false;
+		ret = tevs_mode_switch(tevs, tevs->still.mode);
+		if (!ret) {
+			ret = tevs_still_begin(tevs);
+			if (ret && tevs->streaming)
+				tevs_mode_switch(tevs, tevs->still.preview_mode);
+		}
+		if (ret)
+			dev_err(&client->dev, "still capture failed: %d\n", ret);
+	} else if (tevs->still.leave) {
+		tevs->still.leave = false;
+		ret = tevs_mode_switch(tevs, tevs->still.preview_mode);
+		if (ret)
+			dev_err(&client->dev,
+				"failed to return to preview: %d\n", ret);
+		else
+			tevs_still_end(tevs);
+	}
+	mutex_unlock(&tevs->mutex);
+	mutex_unlock(&tevs->stream_lock);
+}
+
+/*
+ * Reads the control registers of a freshly booted ISP. Values matching the
+ * image are not written again until the next boot, so it is taken after
+ * every reset rather than trusted across them.
+ */
+static void tevs_boot_sample(struct tevs *tevs)
+{
+	int ret;
+
+	ret = tevs_i2c_read(tevs, TEVS_CTRL_IMAGE_BASE, tevs->boot.image,
+			    TEVS_CTRL_IMAGE_SIZE);
+	tevs->boot.valid = !ret;
+	bitmap_zero(tevs->boot.dirty, TEVS_CTRL_IMAGE_SIZE);
+}
+
+static int tevs_power_on(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
+	struct tevs *tevs = to_tevs(sub_dev);
+	int ret = 0;
+
+	dev_dbg(&client->dev, "%s()\n", __func__);
+
+	ret = regulator_bulk_enable(TEVS_NUM_SUPPLIES, tevs->supplies);
+	if (ret) {
+		dev_err(&client->dev, "%s: failed to enable regulators\n",
+			__func__);
+		return ret;
+	}
+
+	// gpiod_set_value_cansleep(tevs->standby_gpio, 0);
+	gpiod_set_value_cansleep(tevs->reset_gpio, 1);
+	msleep(TEVS_BOOT_TIME);
+
+	ret = tevs_check_boot_state(tevs);
+	if(ret != 0) {
+		goto error;
+	}
+	tevs_boot_sample(tevs);
+
+    ret = tevs_init_setting(tevs);
+    if (ret != 0) {
+        dev_err(&client->dev, "init setting failed\n");
+        goto error;
+    }
+
+	return ret;
+
+error:
+	gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+	regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
+	return ret;
+}
+
+static int tevs_power_off(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
+	struct tevs *tevs = to_tevs(sub_dev);
+
+	dev_dbg(&client->dev, "%s()\n", __func__);
+
+    gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+    regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
+
+	return 0;
+}
+
+/* Programs the data-frequency link rate, the ISP reboots with it */
+static int tevs_mipi_freq_apply(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	if (tevs->data_frequency == 0)
+		return 0;
+
+	ret = tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_MIPI_FREQ,
+				 tevs->data_frequency);
+	msleep(TEVS_BOOT_TIME);
+	if (tevs_check_boot_state(tevs) != 0) {
+		dev_err(&client->dev, "check tevs bootup status failed\n");
+		return -EINVAL;
+	}
+	tevs_boot_sample(tevs);
+	if (ret < 0) {
+		dev_err(&client->dev, "set mipi frequency failed\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static bool tevs_stream_healthy(struct tevs *tevs)
+{
+	u16 v;
+
+	/* A single failed read is retried on the next check */
+	if (!tevs_i2c_read_16b(tevs, HOST_COMMAND_TEVS_BOOT_STATE, &v) &&
+	    v != 0x08)
+		return false;
+
+	/* SYSTEM_START is left alone when triggered or reset controlled */
+	if (!(tevs->hw_reset_mode || tevs_trigger_enabled(tevs)) &&
+	    !tevs_i2c_read_16b(tevs, HOST_COMMAND_ISP_CTRL_SYSTEM_START, &v) &&
+	    (v & 0xFF00) != 0x0100)
+		return false;
+
+	return READ_ONCE(tevs->i2c_errors) < TEVS_WATCHDOG_I2C_ERRORS;
+}
+
+/*
+ * Brings a hung ISP back with the stream_lock and mutex held. A soft reset
+ * keeps the supplies up, a power cycle is the last resort. Either way the
+ * link rate from probe, the mode and the controls are programmed again.
+ */
+static int tevs_stream_recover(struct tevs *tevs, u32 *method)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	tevs_stream_teardown(tevs);
+
+	*method = TEVS_RECOVERY_SOFT_RESET;
+	ret = tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_ISP_RESET, 0x0001);
+	if (!ret) {
+		msleep(TEVS_BOOT_TIME);
+		ret = tevs_check_boot_state(tevs);
+	}
+	if (!ret) {
+		tevs_boot_sample(tevs);
+		ret = tevs_init_setting(tevs);
+	}
+	if (!ret)
+		ret = tevs_mipi_freq_apply(tevs);
+
+	if (ret) {
+		dev_warn(&client->dev, "soft reset failed, power cycling\n");
+		*method = TEVS_RECOVERY_POWER_CYCLE;
+		tevs_power_off(&client->dev);
+		ret = tevs_power_on(&client->dev);
+		if (ret)
+			return ret;
+		ret = tevs_mipi_freq_apply(tevs);
+		if (ret)
+			return ret;
+	}
+
+	if (!(tevs->hw_reset_mode || tevs_trigger_enabled(tevs))) {
+		ret = tevs_standby(tevs, 0);
+		if (ret)
+			return ret;
+	}
+
+	return tevs_stream_setup(tevs);
+}
+
+static void tevs_watchdog_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(to_delayed_work(work), struct tevs,
+					 watchdog.work);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	struct v4l2_event ev = { .type = TEVS_EVENT_RECOVERY };
+	struct tevs_event_recovery *data =
+		(struct tevs_event_recovery *)ev.u.data;
+	ktime_t start;
+
+	mutex_lock(&tevs->stream_lock);
+	mutex_lock(&tevs->mutex);
+	if (!tevs->streaming || !tevs->watchdog.enabled)
+		goto out;
+
+	if (tevs_stream_healthy(tevs)) {
+		tevs_watchdog_apply(tevs);
+		goto out;
+	}
+
+	dev_warn(&client->dev, "ISP not responding, recovering\n");
+	start = ktime_get();
+	data->error = tevs_stream_recover(tevs, &data->method);
+	data->duration = ktime_us_delta(ktime_get(), start);
+	data->count = ++tevs->watchdog.recoveries;
+	if (data->error) {
+		dev_err(&client->dev, "recovery failed: %d\n", data->error);
+		/* Tried again on the next check until the stream is stopped */
+		tevs_watchdog_apply(tevs);
+	} else {
+		dev_info(&client->dev, "recovered in %u us\n", data->duration);
+	}
+	v4l2_subdev_notify_event(&tevs->v4l2_subdev, &ev);
+
+out:
+	mutex_unlock(&tevs->mutex);
+	mutex_unlock(&tevs->stream_lock);
+}
+
+static int __maybe_unused tevs_suspend(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
+	struct tevs *tevs = to_tevs(sub_dev);
+
+	dev_dbg(&client->dev, "%s()\n", __func__);
+
+	flush_work(&tevs->stream_work);
+	cancel_delayed_work_sync(&tevs->watchdog.work);
+
+	/* streaming stays set, tevs_resume() starts the stream again */
+	mutex_lock(&tevs->stream_lock);
+	mutex_lock(&tevs->mutex);
+	if (tevs->streaming) {
+		tevs_stream_teardown(tevs);
+		mutex_unlock(&tevs->mutex);
+		tevs_stream_sleep(tevs);
+	} else {
+		mutex_unlock(&tevs->mutex);
+	}
+	mutex_unlock(&tevs->stream_lock);
+
+	/* Whatever the stream left queued would run on a powered off ISP */
+	cancel_delayed_work_sync(&tevs->cmdq.work);
+	cancel_work_sync(&tevs->still.work);
+	cancel_work_sync(&tevs->strobe_work);
+
+	return 0;
+}
+
+static int __maybe_unused tevs_resume(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
+	struct tevs *tevs = to_tevs(sub_dev);
+	int ret;
+
+	dev_dbg(&client->dev, "%s()\n", __func__);
+
+	mutex_lock(&tevs->stream_lock);
+	if (!tevs->streaming) {
+		mutex_unlock(&tevs->stream_lock);
+		return 0;
+	}
+
+	ret = tevs_stream_wake(tevs);
+	mutex_lock(&tevs->mutex);
+	if (!ret) {
+		ret = tevs_stream_setup(tevs);
+		if (ret)
+			pm_runtime_put(&client->dev);
+	}
+	if (ret) {
+		tevs_sync_arm(tevs, false);
+		tevs_stream_set(tevs, false);
+	}
+	mutex_unlock(&tevs->mutex);
+	mutex_unlock(&tevs->stream_lock);
+
+	return ret;
+}
+
+static int tevs_get_regulators(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	unsigned int i;
+
+	for (i = 0; i < TEVS_NUM_SUPPLIES; i++)
+		tevs->supplies[i].supply = tevs_supply_name[i];
+
+	return devm_regulator_bulk_get(&client->dev,
+				       TEVS_NUM_SUPPLIES,
+				       tevs->supplies);
+}
+
+static int tevs_get_frame_interval(struct v4l2_subdev *sub_dev,
+				  struct v4l2_subdev_frame_interval *fi)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	struct tevs_snapshot snap;
+
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+
+	if (fi->pad != 0)
+		return -EINVAL;
+
+	tevs_snapshot_read(tevs, &snap);
+	fi->interval.numerator = 1;
+	fi->interval.denominator = snap.frame_rate;
+
+	return 0;
+}
+
+static int tevs_set_frame_interval(struct v4l2_subdev *sub_dev,
+				  struct v4l2_subdev_frame_interval *fi)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	u32 fps = 0;
+	int ret = 0;
+
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+
+	if (fi->pad != 0)
+		return -EINVAL;
+
+	if (fi->interval.numerator != 0)
+		fps = DIV_ROUND_CLOSEST(fi->interval.denominator,
+					fi->interval.numerator);
+
+	mutex_lock(&tevs->mutex);
+	tevs->fps = clamp_t(u32, fps, 1, tevs_throughput_framerate(tevs));
+	if (tevs->streaming)
+		ret = tevs_frame_rate_apply(tevs);
+
+	fi->interval.numerator = 1;
+	fi->interval.denominator = tevs_frame_rate(tevs);
+	tevs_snapshot_publish(tevs);
+	mutex_unlock(&tevs->mutex);
+
+	return ret;
+}
+
+static int tevs_enum_mbus_code(struct v4l2_subdev *sub_dev,
+			   	  struct v4l2_subdev_state *sub_state,
+			      struct v4l2_subdev_mbus_code_enum *code)
+{
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	if (code->pad || code->index > 0)
+		return -EINVAL;
+
+	code->code = MEDIA_BUS_FMT_UYVY8_2X8;
+
+	return 0;
+}
+
+static int tevs_get_fmt(struct v4l2_subdev *sub_dev,
+			   struct v4l2_subdev_state *sub_state,
+		       struct v4l2_subdev_format *format)
+{
+	struct v4l2_mbus_framefmt *fmt;
+	struct v4l2_mbus_framefmt *mbus_fmt = &format->format;
+	struct tevs *tevs = to_tevs(sub_dev);
+	struct tevs_snapshot snap;
+
+	if (format->pad != 0)
+		return -EINVAL;
+    
+    dev_dbg(sub_dev->dev, "%s() which [%d]\n", __func__, format->which);
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		/* Never waits behind a stream start or stop */
+		tevs_snapshot_read(tevs, &snap);
+		*mbus_fmt = snap.fmt;
+		return 0;
+	}
+
+	mutex_lock(&tevs->mutex);
+	fmt = v4l2_subdev_get_try_format(sub_dev, sub_state, format->pad);
+	memmove(mbus_fmt, fmt, sizeof(struct v4l2_mbus_framefmt));
+	mutex_unlock(&tevs->mutex);
+
+	return 0;
+}
+
+static int tevs_set_fmt(struct v4l2_subdev *sub_dev,
 			   struct v4l2_subdev_state *sub_state,
 		       struct v4l2_subdev_format *format)
 {
-	struct v4l2_mbus_framefmt *fmt;
-	struct v4l2_mbus_framefmt *mbus_fmt = &format->format;
-	struct tevs *tevs = to_tevs(sub_dev);
+	struct v4l2_mbus_framefmt *fmt;
+	struct v4l2_mbus_framefmt *mbus_fmt = &format->format;
+	struct tevs *tevs = to_tevs(sub_dev);
+	int ret = 0;
+	int i;
+
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+
+	if (format->pad != 0)
+		return -EINVAL;
+
+	/* A live switch of the readout mode restarts the stream */
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE)
+		mutex_lock(&tevs->stream_lock);
+	mutex_lock(&tevs->mutex);
+
+	for (i = 0;
+	     i < tevs_sensor_table[tevs->selected_sensor].res_list_size;
+	     i++) {
+		if (mbus_fmt->width ==
+			    tevs_sensor_table[tevs->selected_sensor]
+				    .res_list[i]
+				    .width &&
+		    mbus_fmt->height ==
+			    tevs_sensor_table[tevs->selected_sensor]
+				    .res_list[i]
+				    .height)
+			break;
+	}
+
+	if (i >= tevs_sensor_table[tevs->selected_sensor].res_list_size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
+		if (tevs_still_busy(tevs))
+			ret = -EBUSY;
+		else if (tevs->streaming && i != tevs->selected_mode)
+			ret = tevs_mode_switch(tevs, i);
+		else
+			tevs->selected_mode = i;
+		if (ret)
+			goto out;
+		dev_dbg(sub_dev->dev, "%s() selected mode index [%d]\n",
+			__func__, tevs->selected_mode);
+	}
+
+	mbus_fmt->width =
+		tevs_sensor_table[tevs->selected_sensor].res_list[i].width;
+	mbus_fmt->height = 
+        tevs_sensor_table[tevs->selected_sensor].res_list[i].height;
+	mbus_fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
+	mbus_fmt->colorspace = V4L2_COLORSPACE_SRGB;
+	mbus_fmt->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(mbus_fmt->colorspace);
+	mbus_fmt->quantization = V4L2_QUANTIZATION_FULL_RANGE;
+	mbus_fmt->xfer_func = V4L2_MAP_XFER_FUNC_DEFAULT(mbus_fmt->colorspace);
+	// memset(mbus_fmt->reserved, 0, sizeof(mbus_fmt->reserved));
+
+	if (format->which == V4L2_SUBDEV_FORMAT_TRY)
+		fmt = v4l2_subdev_get_try_format(sub_dev, sub_state, format->pad);
+	else
+		fmt = &tevs->fmt;
+
+	memmove(fmt, mbus_fmt, sizeof(struct v4l2_mbus_framefmt));
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE)
+		tevs_snapshot_publish(tevs);
+
+out:
+	mutex_unlock(&tevs->mutex);
+	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE)
+		mutex_unlock(&tevs->stream_lock);
+
+	return ret;
+}
+
+static int tevs_get_selection(struct v4l2_subdev *sub_dev,
+			    struct v4l2_subdev_state *sub_state,
+				struct v4l2_subdev_selection *sel)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	struct tevs_snapshot snap;
+
+	switch (sel->target) {
+	case V4L2_SEL_TGT_CROP:
+	case V4L2_SEL_TGT_NATIVE_SIZE:
+	case V4L2_SEL_TGT_CROP_DEFAULT:
+	case V4L2_SEL_TGT_CROP_BOUNDS:
+		tevs_snapshot_read(tevs, &snap);
+		sel->r.top = 0;
+		sel->r.left = 0;
+		sel->r.width = snap.fmt.width;
+		sel->r.height = snap.fmt.height;
+		
+		dev_dbg(sub_dev->dev, "%s() selection [%d, %d, %d, %d]\n", __func__,
+			sel->r.top, sel->r.left, sel->r.width, sel->r.height);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static int tevs_enum_frame_size(struct v4l2_subdev *sub_dev,
+			       struct v4l2_subdev_state *sub_state,
+			       struct v4l2_subdev_frame_size_enum *fse)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+
+	if ((fse->pad != 0) ||
+	    (fse->index >=
+	     tevs_sensor_table[tevs->selected_sensor].res_list_size))
+		return -EINVAL;
+
+	fse->min_width = fse->max_width =
+		tevs_sensor_table[tevs->selected_sensor]
+			.res_list[fse->index]
+			.width;
+	fse->min_height = fse->max_height =
+		tevs_sensor_table[tevs->selected_sensor]
+			.res_list[fse->index]
+			.height;
+
+	return 0;
+}
+
+static int tevs_enum_frame_interval(struct v4l2_subdev *sub_dev,
+			       struct v4l2_subdev_state *sub_state,
+				   struct v4l2_subdev_frame_interval_enum *fie)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	int i;
+    
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+
+	if ((fie->pad != 0) || (fie->index != 0))
+		return -EINVAL;
+
+	fie->interval.numerator = 1;
+
+	for (i = 0;
+	     i < tevs_sensor_table[tevs->selected_sensor].res_list_size;
+	     i++) {
+		if (fie->width == tevs_sensor_table[tevs->selected_sensor]
+					  .res_list[i].width &&
+		    fie->height == tevs_sensor_table[tevs->selected_sensor]
+				    .res_list[i].height) {
+			fie->interval.denominator =
+				tevs_mode_framerate(tevs, i);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int tevs_open(struct v4l2_subdev *sub_dev, struct v4l2_subdev_fh *fh)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+	struct v4l2_mbus_framefmt *try_fmt_img =
+		v4l2_subdev_get_try_format(sub_dev, fh->state, 0);
+	struct v4l2_rect *try_crop = 
+        v4l2_subdev_get_try_crop(sub_dev, fh->state, 0);
+
+	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+    
+	mutex_lock(&tevs->mutex);
+
+	/* Initialize try_fmt for the image pad */
+	try_fmt_img = &tevs->fmt;
+
+	/* Initialize try_crop rectangle. */
+	try_crop->top = 0;
+	try_crop->left = 0;
+	try_crop->width = tevs_sensor_table[tevs->selected_sensor].res_list[0].width;
+	try_crop->height = tevs_sensor_table[tevs->selected_sensor].res_list[0].height;
+
+	mutex_unlock(&tevs->mutex);
+
+	return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * V4L2 Controls
+ */
+static const char *const awb_mode_strings[] = {
+	"Manual Temp Mode", // TEVS_AWB_CTRL_MODE_MANUAL_TEMP
+	"Auto Mode", // TEVS_AWB_CTRL_MODE_AUTO
+	NULL,
+};
+
+static const char * const flick_mode_strings[] = {
+	"Disabled", 
+	"50 Hz",
+	"60 Hz",
+	"Auto",
+	NULL,
+};
+
+static const char *const test_pattern_strings[] = {
+	"Disabled",
+	"Solid Color",
+	"Color Bars",
+	"Fade to Gray Color Bars",
+	"Walking 1s",
+	"Frame Counter",
+	NULL,
+};
+
+static const char *const sfx_mode_strings[] = {
+	"Normal Mode", // TEVS_SFX_MODE_SFX_NORMAL
+	"Black and White Mode", // TEVS_SFX_MODE_SFX_BW
+	"Grayscale Mode", // TEVS_SFX_MODE_SFX_GRAYSCALE
+	"Negative Mode", // TEVS_SFX_MODE_SFX_NEGATIVE
+	"Sketch Mode", // TEVS_SFX_MODE_SFX_SKETCH
+	NULL,
+};
+
+static const char *const ae_mode_strings[] = {
+	"Manual Mode", // TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN
+	"Auto Mode", // TEVS_AE_CTRL_FULL_AUTO
+	NULL,
+};
+
+static const char *const latency_profile_strings[] = {
+	"Default",
+	"Low Latency",
+	NULL,
+};
+
+static const char *const sync_role_strings[] = {
+	"Free Run",
+	"Master",
+	"Slave",
+	NULL,
+};
+
+static const char *const strobe_mode_strings[] = {
+	"Every Frame",
+	"Every Nth Frame",
+	"On Trigger",
+	NULL,
+};
+
+static const char *const bsl_mode_strings[] = {
+	"Normal Mode",
+	"Bootstrap Mode",
+	NULL,
+};
+
+static const u16 tevs_awb_modes[] = {
+	TEVS_AWB_CTRL_MODE_MANUAL_TEMP,
+	TEVS_AWB_CTRL_MODE_AUTO,
+};
+
+static const u16 tevs_ae_modes[] = {
+	TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN,
+	TEVS_AE_CTRL_FULL_AUTO,
+};
+
+/*
+ * Control descriptors. A control backed by an ISP register is described by
+ * its value register, width and mask, the optional registers holding its
+ * range and, for menus, the register value of each item. The generic engine
+ * below reads, writes and discovers the range of such controls, so adding
+ * one takes a table entry only. Controls mirrored in driver state name the
+ * field instead, and controls with side effects supply set/get hooks.
+ */
+#define TEVS_CTRL_FIELD                   BIT(0) /* bits of a shared register */
+#define TEVS_CTRL_AE                      BIT(1) /* held while bracketing */
+#define TEVS_CTRL_ISP                     BIT(2) /* held in low latency */
+#define TEVS_CTRL_IDLE                    BIT(3) /* set only while stopped */
+#define TEVS_CTRL_PRESET                  BIT(4) /* saved in presets */
+
+struct tevs_ctrl_desc {
+	struct v4l2_ctrl_config cfg;
+	u16 reg;
+	u8 width;
+	u32 mask;
+	u16 max_reg;
+	u16 min_reg;
+	const u16 *menu;
+	u32 flags;
+	size_t state;
+	u8 state_size;
+	int (*set)(struct tevs *tevs, struct v4l2_ctrl *ctrl);
+	int (*get)(struct tevs *tevs, struct v4l2_ctrl *ctrl);
+	int (*apply)(struct tevs *tevs);
+};
+
+#define TEVS_CTRL_STATE(field)                                                 \
+	.state = offsetof(struct tevs, field),                                 \
+	.state_size = sizeof_field(struct tevs, field)
+
+static int tevs_ctrl_read_raw(struct tevs *tevs, u16 reg, u8 width, u32 *val)
+{
+	u8 data[4];
+	int ret;
+
+	ret = tevs_i2c_read(tevs, reg, data, width);
+	if (ret)
+		return ret;
+
+	*val = width == 4 ? get_unaligned_be32(data) :
+			    get_unaligned_be16(data);
+
+	return 0;
+}
+
+static int tevs_ctrl_write_raw(struct tevs *tevs, u16 reg, u8 width, u32 val)
+{
+	u8 data[4];
+
+	if (width == 4)
+		put_unaligned_be32(val, data);
+	else
+		put_unaligned_be16(val, data);
+
+	return tevs_i2c_write(tevs, reg, data, width);
+}
+
+static int tevs_ctrl_reg_read(struct tevs *tevs,
+			      const struct tevs_ctrl_desc *desc, s32 *val)
+{
+	unsigned int i;
+	u32 reg;
+	int ret;
+
+	ret = tevs_ctrl_read_raw(tevs, desc->reg, desc->width, &reg);
+	if (ret)
+		return ret;
+
+	reg &= desc->mask;
+	if (desc->flags & TEVS_CTRL_FIELD) {
+		*val = reg >> __ffs(desc->mask);
+	} else if (desc->menu) {
+		/* Values without a menu item read back as the default */
+		*val = desc->cfg.def;
+		for (i = 0; i <= desc->cfg.max; i++) {
+			if (desc->menu[i] == reg) {
+				*val = i;
+				break;
+			}
+		}
+	} else {
+		*val = reg;
+	}
+
+	return 0;
+}
+
+static u32 tevs_ctrl_reg_value(const struct tevs_ctrl_desc *desc, s32 val)
+{
+	if (desc->menu)
+		return desc->menu[val];
 
-	mutex_lock(&tevs->mutex);
+	return val & desc->mask;
+}
 
-	if (format->pad != 0)
-		return -EINVAL;
-    
-    dev_dbg(sub_dev->dev, "%s() which [%d]\n", __func__, format->which);
-	if (format->which == V4L2_SUBDEV_FORMAT_TRY)
-		fmt = v4l2_subdev_get_try_format(sub_dev, sub_state, format->pad);
+/*
+ * True when the ISP still holds the power-on value of the control register
+ * and that is the value wanted, so writing it can be skipped.
+ */
+static bool tevs_ctrl_at_boot(struct tevs *tevs,
+			      const struct tevs_ctrl_desc *desc, s32 val)
+{
+	unsigned int offset;
+	u32 reg;
+
+	if (!tevs->boot.valid || desc->reg < TEVS_CTRL_IMAGE_BASE ||
+	    desc->reg + desc->width > TEVS_CTRL_IMAGE_BASE + TEVS_CTRL_IMAGE_SIZE)
+		return false;
+
+	offset = desc->reg - TEVS_CTRL_IMAGE_BASE;
+	if (find_next_bit(tevs->boot.dirty, offset + desc->width, offset) <
+	    offset + desc->width)
+		return false;
+
+	reg = desc->width == 4 ? get_unaligned_be32(&tevs->boot.image[offset]) :
+				 get_unaligned_be16(&tevs->boot.image[offset]);
+	if (desc->flags & TEVS_CTRL_FIELD)
+		return (reg & desc->mask) >> __ffs(desc->mask) == val;
+
+	return reg == tevs_ctrl_reg_value(desc, val);
+}
+
+static int tevs_ctrl_reg_write(struct tevs *tevs,
+			       const struct tevs_ctrl_desc *desc, s32 val)
+{
+	u32 reg;
+	int ret;
+
+	if (!(desc->flags & TEVS_CTRL_FIELD))
+		return tevs_ctrl_write_raw(tevs, desc->reg, desc->width,
+					   tevs_ctrl_reg_value(desc, val));
+
+	ret = tevs_ctrl_read_raw(tevs, desc->reg, desc->width, &reg);
+	if (ret)
+		return ret;
+
+	reg &= ~desc->mask;
+	reg |= (val << __ffs(desc->mask)) & desc->mask;
+
+	return tevs_ctrl_write_raw(tevs, desc->reg, desc->width, reg);
+}
+
+static s32 tevs_ctrl_state_get(struct tevs *tevs,
+			       const struct tevs_ctrl_desc *desc)
+{
+	void *state = (void *)tevs + desc->state;
+
+	switch (desc->state_size) {
+	case 1:
+		return *(u8 *)state;
+	case 2:
+		return *(u16 *)state;
+	default:
+		return *(u32 *)state;
+	}
+}
+
+static void tevs_ctrl_state_put(struct tevs *tevs,
+				const struct tevs_ctrl_desc *desc, s32 val)
+{
+	void *state = (void *)tevs + desc->state;
+
+	switch (desc->state_size) {
+	case 1:
+		*(u8 *)state = val;
+		break;
+	case 2:
+		*(u16 *)state = val;
+		break;
+	default:
+		*(u32 *)state = val;
+		break;
+	}
+}
+
+/* Reads the range of a control from its limit registers */
+static int tevs_ctrl_range(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	const struct tevs_ctrl_desc *desc = ctrl->priv;
+	u32 val;
+	int ret;
+
+	if (!desc->max_reg)
+		return 0;
+
+	ret = tevs_ctrl_read_raw(tevs, desc->max_reg, desc->width, &val);
+	if (ret)
+		return ret;
+
+	ctrl->maximum = val & desc->mask;
+	ret = tevs_ctrl_read_raw(tevs, desc->min_reg, desc->width, &val);
+	if (ret)
+		return ret;
+
+	ctrl->minimum = val & desc->mask;
+
+	return 0;
+}
+
+/* Held controls are applied again when bracketing or low latency ends */
+static bool tevs_ctrl_held(struct tevs *tevs, const struct tevs_ctrl_desc *desc)
+{
+	return ((desc->flags & TEVS_CTRL_AE) && tevs->bracket.active) ||
+	       ((desc->flags & TEVS_CTRL_ISP) && tevs->low_latency);
+}
+
+/* Plain register controls, replayed together by tevs_ctrls_batch_write() */
+static bool tevs_ctrl_batched(const struct tevs_ctrl_desc *desc)
+{
+	return desc->reg && !desc->set && !(desc->flags & TEVS_CTRL_FIELD) &&
+	       desc->reg >= TEVS_CTRL_IMAGE_BASE &&
+	       desc->reg < TEVS_CTRL_IMAGE_BASE + TEVS_CTRL_IMAGE_SIZE;
+}
+
+/*
+ * Register images. Adjacent value registers are written as one run in a
+ * single transfer. The MAX and MIN limit registers are read only as far
+ * as the driver knows, so they are never part of an image and split the
+ * runs around them.
+ */
+static void tevs_ctrl_image_put(u8 *image, unsigned long *valid, u16 reg,
+				u8 width, u32 val)
+{
+	unsigned int offset = reg - TEVS_CTRL_IMAGE_BASE;
+
+	if (width == 4)
+		put_unaligned_be32(val, &image[offset]);
 	else
-		fmt = &tevs->fmt;
+		put_unaligned_be16(val, &image[offset]);
+	bitmap_set(valid, offset, width);
+}
 
-	memmove(mbus_fmt, fmt, sizeof(struct v4l2_mbus_framefmt));
+static void tevs_ctrl_image_add(u8 *image, unsigned long *valid,
+				struct v4l2_ctrl *ctrl)
+{
+	const struct tevs_ctrl_desc *desc = ctrl->priv;
+
+	tevs_ctrl_image_put(image, valid, desc->reg, desc->width,
+			    tevs_ctrl_reg_value(desc, ctrl->cur.val));
+}
+
+/* Writes each contiguous run of an image */
+static int tevs_ctrl_image_write(struct tevs *tevs, u8 *image,
+				 unsigned long *valid, u32 *transfers)
+{
+	unsigned int start, end;
+	int ret;
+
+	for_each_set_bitrange(start, end, valid, TEVS_CTRL_IMAGE_SIZE) {
+		ret = tevs_i2c_write(tevs, TEVS_CTRL_IMAGE_BASE + start,
+				     &image[start], end - start);
+		if (ret)
+			return ret;
+		if (transfers)
+			(*transfers)++;
+	}
+
+	return 0;
+}
+
+/*
+ * Control write queue. With Ctrl_Queue set, plain register controls only
+ * note the control, cmdq.work writes the latest value of all noted
+ * controls after TEVS_CMDQ_WINDOW_MS. Repeated writes to a control fold
+ * into one. This saves bus transfers only, s_ctrl still runs under
+ * tevs->mutex and waits behind stream transitions like any control.
+ */
+static bool tevs_cmdq_queue(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	u32 *stats = tevs->cmdq.stats;
+	unsigned int i;
+
+	for (i = 0; i < tevs->cmdq.depth; i++) {
+		if (tevs->cmdq.ctrls[i] == ctrl) {
+			stats[TEVS_CMDQ_STAT_QUEUED]++;
+			stats[TEVS_CMDQ_STAT_COALESCED]++;
+			return true;
+		}
+	}
+
+	if (tevs->cmdq.depth == TEVS_CMDQ_DEPTH)
+		return false;
+
+	tevs->cmdq.ctrls[tevs->cmdq.depth++] = ctrl;
+	stats[TEVS_CMDQ_STAT_QUEUED]++;
+	stats[TEVS_CMDQ_STAT_PEAK] = max(stats[TEVS_CMDQ_STAT_PEAK],
+					 tevs->cmdq.depth);
+	queue_delayed_work(system_highpri_wq, &tevs->cmdq.work,
+			   msecs_to_jiffies(TEVS_CMDQ_WINDOW_MS));
+
+	return true;
+}
+
+/* Called with tevs->mutex held, the control values are current */
+static int tevs_cmdq_drain(struct tevs *tevs)
+{
+	u8 image[TEVS_CTRL_IMAGE_SIZE];
+	DECLARE_BITMAP(valid, TEVS_CTRL_IMAGE_SIZE);
+	struct v4l2_ctrl *ctrl;
+	unsigned int i;
+
+	/*
+	 * Runtime PM may have powered the ISP off, tevs_ctrls_batch_write()
+	 * writes the values at the next stream start.
+	 */
+	if (!tevs->streaming) {
+		tevs->cmdq.depth = 0;
+		return 0;
+	}
+
+	bitmap_zero(valid, TEVS_CTRL_IMAGE_SIZE);
+	for (i = 0; i < tevs->cmdq.depth; i++) {
+		ctrl = tevs->cmdq.ctrls[i];
+		/* Applied again when the hold ends */
+		if (!tevs_ctrl_held(tevs, ctrl->priv))
+			tevs_ctrl_image_add(image, valid, ctrl);
+	}
+	tevs->cmdq.depth = 0;
+
+	return tevs_ctrl_image_write(tevs, image, valid,
+				     &tevs->cmdq.stats[TEVS_CMDQ_STAT_TRANSFERS]);
+}
+
+static void tevs_cmdq_work(struct work_struct *work)
+{
+	struct tevs *tevs = container_of(to_delayed_work(work), struct tevs,
+					 cmdq.work);
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	int ret;
+
+	mutex_lock(&tevs->mutex);
+	ret = tevs_cmdq_drain(tevs);
 	mutex_unlock(&tevs->mutex);
+	if (ret)
+		dev_err(&client->dev, "queued control write failed: %d\n",
+			ret);
+}
+
+static int tevs_ctrl_set_cmdq(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	tevs->cmdq.enabled = ctrl->val;
+	if (tevs->cmdq.enabled)
+		return 0;
+
+	return tevs_cmdq_drain(tevs);
+}
+
+static int tevs_ctrl_get_cmdq_stats(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	tevs->cmdq.stats[TEVS_CMDQ_STAT_DEPTH] = tevs->cmdq.depth;
+	memcpy(ctrl->p_new.p_u32, tevs->cmdq.stats, sizeof(tevs->cmdq.stats));
 
 	return 0;
 }
 
-static int tevs_set_fmt(struct v4l2_subdev *sub_dev,
-			   struct v4l2_subdev_state *sub_state,
-		       struct v4l2_subdev_format *format)
+static int tevs_preset_save(struct tevs *tevs, const char *name);
+static int tevs_preset_apply(struct tevs *tevs, const char *name);
+static int tevs_preset_delete(struct tevs *tevs, const char *name);
+
+static int tevs_ctrl_set_preset(struct tevs *tevs, struct v4l2_ctrl *ctrl)
 {
-	struct v4l2_mbus_framefmt *fmt;
-	struct v4l2_mbus_framefmt *mbus_fmt = &format->format;
-	struct tevs *tevs = to_tevs(sub_dev);
-	int i;
+	const char *name = ctrl->p_new.p_char;
 
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	/* The preset controls act on writes only */
+	if (tevs->ctrl_replay)
+		return 0;
+	/* Names are listed comma separated */
+	if (!name[0] || strchr(name, ','))
+		return -EINVAL;
 
-	if (format->pad != 0)
+	switch (ctrl->id) {
+	case V4L2_CID_TEVS_PRESET_SAVE:
+		return tevs_preset_save(tevs, name);
+	case V4L2_CID_TEVS_PRESET_APPLY:
+		return tevs_preset_apply(tevs, name);
+	default:
+		return tevs_preset_delete(tevs, name);
+	}
+}
+
+static int tevs_ctrl_get_preset_list(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	char *list = ctrl->p_new.p_char;
+	size_t len = 0;
+	unsigned int i;
+
+	list[0] = '\0';
+	for (i = 0; i < TEVS_PRESET_SLOTS; i++) {
+		if (!tevs->presets[i].name[0])
+			continue;
+
+		len += scnprintf(list + len, ctrl->elem_size - len, "%s%s",
+				 len ? "," : "", tevs->presets[i].name);
+	}
+
+	return 0;
+}
+
+static int tevs_ctrl_set_ae(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	int ret;
+
+	/* A preset applied while stopped is left to the stream setup */
+	if (tevs->ctrl_bulk && !tevs->streaming)
+		return 0;
+
+	ret = tevs_ctrl_reg_write(tevs, ctrl->priv, ctrl->val);
+	/* The manual exposure and gain may still hold a seed */
+	if (!ret && ctrl->val == TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN_IDX &&
+	    tevs->exposure_ctrl) {
+		ret = tevs_write_exposure(tevs, tevs->exposure_ctrl->cur.val);
+		ret = ret ?: tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
+			tevs->gain_ctrl->cur.val & TEVS_AE_MANUAL_GAIN_MASK);
+	}
+	if (!ret && tevs->streaming)
+		tevs_converge_start(tevs,
+				    ctrl->val == TEVS_AE_CTRL_FULL_AUTO_IDX);
+
+	return ret;
+}
+
+static int tevs_ctrl_set_flicker(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	if (tevs->ctrl_bulk && !tevs->streaming)
+		return 0;
+
+	return tevs_flick_ctrl_write(tevs, ctrl->val);
+}
+
+static int tevs_ctrl_get_flicker(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	u16 val;
+	int ret;
+
+	ret = tevs_i2c_read_16b(tevs, TEVS_FLICK_CTRL, &val);
+	if (ret)
+		return ret;
+
+	switch (val & TEVS_FLICK_CTRL_MODE_MASK) {
+	case TEVS_FLICK_CTRL_MODE_MANUAL:
+		if ((val & TEVS_FLICK_CTRL_FREQ_MASK) == TEVS_FLICK_CTRL_FREQ(50))
+			ctrl->val = 1;
+		else if ((val & TEVS_FLICK_CTRL_FREQ_MASK) == TEVS_FLICK_CTRL_FREQ(60))
+			ctrl->val = 2;
+		break;
+	case TEVS_FLICK_CTRL_MODE_AUTO:
+		ctrl->val = 3;
+		break;
+	default:
+		ctrl->val = 0;
+		break;
+	}
+
+	return 0;
+}
+
+static int tevs_ctrl_set_eptz_axis(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	const struct tevs_ctrl_desc *desc = ctrl->priv;
+	unsigned int axis;
+
+	/* The viewport is replayed from the driver copy in one transfer */
+	if (tevs->ctrl_replay)
+		return 0;
+
+	if (ctrl->id == V4L2_CID_PAN_ABSOLUTE)
+		axis = TEVS_EPTZ_PAN;
+	else if (ctrl->id == V4L2_CID_TILT_ABSOLUTE)
+		axis = TEVS_EPTZ_TILT;
+	else
+		axis = TEVS_EPTZ_ZOOM;
+
+	tevs->eptz.moving = false;
+	tevs->eptz.pos[axis] = ctrl->val & desc->mask;
+	/* A preset writes all axes once it is in */
+	if (tevs->ctrl_bulk)
+		return 0;
+
+	return tevs_ctrl_reg_write(tevs, desc, ctrl->val);
+}
+
+static int tevs_ctrl_set_eptz(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	if (tevs->ctrl_replay)
+		return 0;
+
+	return tevs_eptz_set(tevs, ctrl->p_new.p_u32);
+}
+
+static int tevs_ctrl_get_eptz(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	ctrl->p_new.p_u32[TEVS_EPTZ_PAN] = tevs->eptz.pos[TEVS_EPTZ_PAN];
+	ctrl->p_new.p_u32[TEVS_EPTZ_TILT] = tevs->eptz.pos[TEVS_EPTZ_TILT];
+	ctrl->p_new.p_u32[TEVS_EPTZ_ZOOM] = tevs->eptz.pos[TEVS_EPTZ_ZOOM];
+
+	return 0;
+}
+
+static int tevs_ctrl_set_hdr(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	if (ctrl->val && !tevs_sensor_has_hdr(tevs))
 		return -EINVAL;
-    
-	mutex_lock(&tevs->mutex);
 
-	for (i = 0;
-	     i < tevs_sensor_table[tevs->selected_sensor].res_list_size;
-	     i++) {
-		if (mbus_fmt->width ==
-			    tevs_sensor_table[tevs->selected_sensor]
-				    .res_list[i]
-				    .width &&
-		    mbus_fmt->height ==
-			    tevs_sensor_table[tevs->selected_sensor]
-				    .res_list[i]
-				    .height)
-			break;
+	tevs->hdr = ctrl->val;
+	tevs_snapshot_publish(tevs);
+	/* Applied at stream start when the mode is known */
+	if (!tevs->streaming && !tevs->ctrl_replay)
+		return 0;
+
+	return tevs_hdr_apply(tevs);
+}
+
+static int tevs_ctrl_set_throughput(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+
+	if (!tevs->streaming && !tevs->ctrl_replay) {
+		tevs->throughput = ctrl->val;
+		return 0;
 	}
 
-	if (i >= tevs_sensor_table[tevs->selected_sensor].res_list_size) {
+	/* The running mode must still fit into the capped link */
+	if (ctrl->val &&
+	    tevs_mode_bandwidth(tevs, tevs_frame_rate(tevs)) > ctrl->val) {
+		dev_err(&client->dev,
+			"throughput %d Mbit/s below %d Mbit/s needed by the mode\n",
+			ctrl->val,
+			tevs_mode_bandwidth(tevs, tevs_frame_rate(tevs)));
 		return -EINVAL;
 	}
-	tevs->selected_mode = i;
-	dev_dbg(sub_dev->dev, "%s() selected mode index [%d]\n", __func__,
-		tevs->selected_mode);
 
-	mbus_fmt->width =
-		tevs_sensor_table[tevs->selected_sensor].res_list[i].width;
-	mbus_fmt->height = 
-        tevs_sensor_table[tevs->selected_sensor].res_list[i].height;
-	mbus_fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
-	mbus_fmt->colorspace = V4L2_COLORSPACE_SRGB;
-	mbus_fmt->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(mbus_fmt->colorspace);
-	mbus_fmt->quantization = V4L2_QUANTIZATION_FULL_RANGE;
-	mbus_fmt->xfer_func = V4L2_MAP_XFER_FUNC_DEFAULT(mbus_fmt->colorspace);
-	// memset(mbus_fmt->reserved, 0, sizeof(mbus_fmt->reserved));
+	tevs->throughput = ctrl->val;
+	if (tevs->low_latency)
+		return 0;
 
-	if (format->which == V4L2_SUBDEV_FORMAT_TRY)
-		fmt = v4l2_subdev_get_try_format(sub_dev, sub_state, format->pad);
-	else
-		fmt = &tevs->fmt;
+	return tevs_i2c_write_16b(tevs, HOST_COMMAND_ISP_CTRL_PREVIEW_THROUGHPUT,
+				  ctrl->val);
+}
+
+static int tevs_ctrl_get_pixel_rate(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	ctrl->val64 = tevs_pixel_rate(tevs);
+
+	return 0;
+}
+
+static int tevs_ctrl_set_software_trigger(struct tevs *tevs,
+					  struct v4l2_ctrl *ctrl)
+{
+	return tevs_software_trigger(tevs);
+}
+
+static int tevs_ctrl_set_sync_role(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	/* A slave trigger mode is programmed on the next power on */
+	return tevs_sync_set_role(tevs, ctrl->val);
+}
+
+static int tevs_ctrl_get_sync_skew(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	ctrl->val = tevs_sync_skew(tevs);
+
+	return 0;
+}
 
-	memmove(fmt, mbus_fmt, sizeof(struct v4l2_mbus_framefmt));
+static int tevs_ctrl_set_trigger(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	if (tevs->trigger_timer)
+		return -EBUSY;
 
-	mutex_unlock(&tevs->mutex);
+	/* Taken by the generator at the next stream start */
+	tevs_ctrl_state_put(tevs, ctrl->priv, ctrl->val);
 
 	return 0;
 }
 
-static int tevs_get_selection(struct v4l2_subdev *sub_dev,
-			    struct v4l2_subdev_state *sub_state,
-				struct v4l2_subdev_selection *sel)
+static int tevs_ctrl_get_trigger_missed(struct tevs *tevs,
+					struct v4l2_ctrl *ctrl)
 {
-	struct tevs *tevs = to_tevs(sub_dev);
-	switch (sel->target) {
-	case V4L2_SEL_TGT_CROP:
-	case V4L2_SEL_TGT_NATIVE_SIZE:
-	case V4L2_SEL_TGT_CROP_DEFAULT:
-	case V4L2_SEL_TGT_CROP_BOUNDS:
-		sel->r.top = 0;
-		sel->r.left = 0;
-		sel->r.width = tevs->fmt.width;
-		sel->r.height = tevs->fmt.height;
-		
-		dev_dbg(sub_dev->dev, "%s() selection [%d, %d, %d, %d]\n", __func__,
-			sel->r.top, sel->r.left, sel->r.width, sel->r.height);
-		return 0;
-	}
+	mutex_lock(&tevs_trigger_lock);
+	ctrl->val = tevs->trigger_missed;
+	mutex_unlock(&tevs_trigger_lock);
 
-	return -EINVAL;
+	return 0;
 }
 
-static int tevs_enum_frame_size(struct v4l2_subdev *sub_dev,
-			       struct v4l2_subdev_state *sub_state,
-			       struct v4l2_subdev_frame_size_enum *fse)
+static int tevs_ctrl_set_flash_mode(struct tevs *tevs, struct v4l2_ctrl *ctrl)
 {
-	struct tevs *tevs = to_tevs(sub_dev);
-
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	tevs->flash_led_mode = ctrl->val;
+	tevs_flash_apply(tevs);
 
-	if ((fse->pad != 0) ||
-	    (fse->index >=
-	     tevs_sensor_table[tevs->selected_sensor].res_list_size))
-		return -EINVAL;
+	return 0;
+}
 
-	fse->min_width = fse->max_width =
-		tevs_sensor_table[tevs->selected_sensor]
-			.res_list[fse->index]
-			.width;
-	fse->min_height = fse->max_height =
-		tevs_sensor_table[tevs->selected_sensor]
-			.res_list[fse->index]
-			.height;
+static int tevs_ctrl_set_strobe_mode(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	tevs_ctrl_state_put(tevs, ctrl->priv, ctrl->val);
+	atomic_set(&tevs->strobe_frames, 0);
 
 	return 0;
 }
 
-static int tevs_enum_frame_interval(struct v4l2_subdev *sub_dev,
-			       struct v4l2_subdev_state *sub_state,
-				   struct v4l2_subdev_frame_interval_enum *fie)
+static int tevs_ctrl_set_strobe(struct tevs *tevs, struct v4l2_ctrl *ctrl)
 {
-	struct tevs *tevs = to_tevs(sub_dev);
-	int i;
-    
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
+	if (!tevs->flash_gpio)
+		return -ENODEV;
+	if (tevs->flash_led_mode != V4L2_FLASH_LED_MODE_FLASH ||
+	    tevs->strobe_source != V4L2_FLASH_STROBE_SOURCE_SOFTWARE)
+		return -EBUSY;
 
-	if ((fie->pad != 0) || (fie->index != 0))
-		return -EINVAL;
+	/* Pulsed from the work, the control lock is not held for the flash */
+	queue_work(system_highpri_wq, &tevs->strobe_work);
 
-	fie->interval.numerator = 1;
+	return 0;
+}
 
-	for (i = 0;
-	     i < tevs_sensor_table[tevs->selected_sensor].res_list_size;
-	     i++) {
-		if (fie->width == tevs_sensor_table[tevs->selected_sensor]
-					  .res_list[i].width &&
-		    fie->height == tevs_sensor_table[tevs->selected_sensor]
-				    .res_list[i].height) {
-			fie->interval.denominator =
-				tevs_sensor_table[tevs->selected_sensor]
-					.res_list[i].framerates;
-			break;
-		}
-	}
+static int tevs_ctrl_set_strobe_stop(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	if (!tevs->flash_gpio)
+		return -ENODEV;
+
+	/*
+	 * Cuts a strobe short. strobe_work still waits out the duration
+	 * before it clears strobe_on.
+	 */
+	gpiod_set_value_cansleep(tevs->flash_gpio, 0);
 
 	return 0;
 }
 
-static int tevs_open(struct v4l2_subdev *sub_dev, struct v4l2_subdev_fh *fh)
+static int tevs_ctrl_set_still(struct tevs *tevs, struct v4l2_ctrl *ctrl)
 {
-	struct tevs *tevs = to_tevs(sub_dev);
-	struct v4l2_mbus_framefmt *try_fmt_img =
-		v4l2_subdev_get_try_format(sub_dev, fh->state, 0);
-	struct v4l2_rect *try_crop = 
-        v4l2_subdev_get_try_crop(sub_dev, fh->state, 0);
+	if (tevs_still_busy(tevs))
+		return -EBUSY;
 
-	dev_dbg(sub_dev->dev, "%s()\n", __func__);
-    
-	mutex_lock(&tevs->mutex);
+	tevs_ctrl_state_put(tevs, ctrl->priv, ctrl->val);
 
-	/* Initialize try_fmt for the image pad */
-	try_fmt_img = &tevs->fmt;
+	return 0;
+}
 
-	/* Initialize try_crop rectangle. */
-	try_crop->top = 0;
-	try_crop->left = 0;
-	try_crop->width = tevs_sensor_table[tevs->selected_sensor].res_list[0].width;
-	try_crop->height = tevs_sensor_table[tevs->selected_sensor].res_list[0].height;
+static int tevs_ctrl_set_still_capture(struct tevs *tevs,
+				       struct v4l2_ctrl *ctrl)
+{
+	return tevs_still_start(tevs);
+}
 
-	mutex_unlock(&tevs->mutex);
+static int tevs_ctrl_set_bracket_seq(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	memcpy(tevs->bracket.steps, ctrl->p_new.p_u32,
+	       sizeof(tevs->bracket.steps));
 
 	return 0;
 }
 
-/* -----------------------------------------------------------------------------
- * V4L2 Controls
- */
-static const char *const awb_mode_strings[] = {
-	"Manual Temp Mode", // TEVS_AWB_CTRL_MODE_MANUAL_TEMP
-	"Auto Mode", // TEVS_AWB_CTRL_MODE_AUTO
-	NULL,
-};
+static int tevs_ctrl_set_bracket_count(struct tevs *tevs,
+				       struct v4l2_ctrl *ctrl)
+{
+	tevs_bracket_stop(tevs);
+	tevs->bracket.count = ctrl->val;
+	if (!tevs->streaming)
+		return 0;
 
-static const char * const flick_mode_strings[] = {
-	"Disabled", 
-	"50 Hz",
-	"60 Hz",
-	"Auto",
-	NULL,
-};
+	return tevs_bracket_start(tevs);
+}
 
-static const char *const sfx_mode_strings[] = {
-	"Normal Mode", // TEVS_SFX_MODE_SFX_NORMAL
-	"Black and White Mode", // TEVS_SFX_MODE_SFX_BW
-	"Grayscale Mode", // TEVS_SFX_MODE_SFX_GRAYSCALE
-	"Negative Mode", // TEVS_SFX_MODE_SFX_NEGATIVE
-	"Sketch Mode", // TEVS_SFX_MODE_SFX_SKETCH
-	NULL,
-};
+static int tevs_ctrl_set_bsl(struct tevs *tevs, struct v4l2_ctrl *ctrl)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	u8 bootcmd[6] = {0x00, 0x12, 0x3A, 0x61, 0x44, 0xDE};
+	u8 startup[6] = {0x00, 0x40, 0xE2, 0x51, 0x21, 0x5B};
+	u8 tmp;
+	int ret;
 
-static const char *const ae_mode_strings[] = {
-	"Manual Mode", // TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN
-	"Auto Mode", // TEVS_AE_CTRL_FULL_AUTO
-	NULL,
-};
+	dev_dbg(&client->dev, "%s(): set bls mode: %d", __func__, ctrl->val);
+
+	switch (ctrl->val) {
+	case TEVS_BSL_MODE_NORMAL_IDX:
+		ret = tevs_i2c_write(tevs, 0x8001, startup, 6);
+		ret = tevs_i2c_read(tevs, 0x8001, &tmp, 1);
+		break;
+	case TEVS_BSL_MODE_FLASH_IDX:
+		ret = regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
+		gpiod_set_value_cansleep(tevs->reset_gpio, 0);
+		usleep_range(9000, 10000);
+		gpiod_set_value_cansleep(tevs->standby_gpio, 1);
+		msleep(100);
+		ret = regulator_bulk_enable(TEVS_NUM_SUPPLIES, tevs->supplies);
+		gpiod_set_value_cansleep(tevs->reset_gpio, 1);
+		usleep_range(9000, 10000);
+		gpiod_set_value_cansleep(tevs->standby_gpio, 0);
+		msleep(100);
+		ret = tevs_i2c_write(tevs, 0x8001, bootcmd, 6);
+		msleep(100);
+		ret = tevs_i2c_read(tevs, 0x8001, &tmp, 1);
+		break;
+	default:
+		dev_err(&client->dev, "%s(): set err bls mode: %d", __func__,
+			ctrl->val);
+		ret = -EINVAL;
+		break;
+	}
 
-static const char *const bsl_mode_strings[] = {
-	"Normal Mode",
-	"Bootstrap Mode",
-	NULL,
-};
+	return ret;
+}
 
 static int tevs_s_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct tevs *tevs = container_of(ctrl->handler, struct tevs, ctrls);
-	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
-	int ret;
+	const struct tevs_ctrl_desc *desc = ctrl->priv;
 
-	switch (ctrl->id) {
-	case V4L2_CID_BRIGHTNESS:
-        ret = tevs_i2c_write_16b(tevs, TEVS_BRIGHTNESS,
-                        ctrl->val & TEVS_BRIGHTNESS_MASK);
-        break;
-	case V4L2_CID_CONTRAST:
-        ret = tevs_i2c_write_16b(tevs, TEVS_CONTRAST,
-                        ctrl->val & TEVS_CONTRAST_MASK);
-        break;
-	case V4L2_CID_SATURATION:
-		ret = tevs_i2c_write_16b(tevs, TEVS_SATURATION,
-                        ctrl->val & TEVS_SATURATION_MASK);
-        break;
-	case V4L2_CID_AUTO_WHITE_BALANCE: {
-        u16 val;
-        switch (ctrl->val & TEVS_AWB_CTRL_MODE_MASK) {
-        case 0:
-            val = TEVS_AWB_CTRL_MODE_MANUAL_TEMP;
-            break;
-        case 1:
-            val = TEVS_AWB_CTRL_MODE_AUTO;
-            break;
-        default:
-            val = TEVS_AWB_CTRL_MODE_AUTO;
-            break;
-        }
-	    ret = tevs_i2c_write_16b(tevs, TEVS_AWB_CTRL_MODE, val);
-        break;
-    }
-	case V4L2_CID_GAMMA:
-		ret = tevs_i2c_write_16b(tevs, TEVS_GAMMA,
-                        ctrl->val & TEVS_GAMMA_MASK);
-        break;
-	case V4L2_CID_EXPOSURE: {
-        u8 exp[4];
-        __be32 exp_temp;
-	    exp_temp = cpu_to_be32(ctrl->val);
-	    memcpy(exp, &exp_temp, 4);
-	    ret = tevs_i2c_write(tevs, TEVS_AE_MANUAL_EXP_TIME,
-                    exp, 4);
-        break;
-    }
-	case V4L2_CID_GAIN:
-        ret = tevs_i2c_write_16b(tevs, TEVS_AE_MANUAL_GAIN,
-                        ctrl->val & TEVS_AE_MANUAL_GAIN_MASK);
-        break;
-	case V4L2_CID_HFLIP: {
-        u16 val;
-		ret = tevs_i2c_read_16b(tevs, TEVS_ORIENTATION,
-				        &val);
-        val &= ~TEVS_ORIENTATION_HFLIP;
-        val |= ctrl->val ? TEVS_ORIENTATION_HFLIP : 0;
-
-	    ret = tevs_i2c_write_16b(tevs, TEVS_ORIENTATION,
-                            val);
-        break;
-    }
-	case V4L2_CID_VFLIP: {
-        u16 val;
-        ret = tevs_i2c_read_16b(tevs, TEVS_ORIENTATION,
-                        &val);
-        val &= ~TEVS_ORIENTATION_VFLIP;
-        val |= ctrl->val ? TEVS_ORIENTATION_VFLIP : 0;
-
-        ret = tevs_i2c_write_16b(tevs, TEVS_ORIENTATION,
-                            val);
-        break;
-    }
-	case V4L2_CID_POWER_LINE_FREQUENCY: {
-        u16 val;
-        switch(ctrl->val) {
-        case 0:
-            val = TEVS_FLICK_CTRL_MODE_DISABLED;
-            break;
-        case 1:
-            val = TEVS_FLICK_CTRL_MODE_50HZ;
-            break;
-        case 2:
-            val = TEVS_FLICK_CTRL_MODE_60HZ;
-            break;
-        case 3:
-            val = TEVS_FLICK_CTRL_MODE_AUTO | 
-                    TEVS_FLICK_CTRL_FRC_OVERRIDE_UPPER_ET | 
-                    TEVS_FLICK_CTRL_FRC_EN;
-            break;
-        default:
-            val = TEVS_FLICK_CTRL_MODE_DISABLED;
-            break;
-        }
-	    ret = tevs_i2c_write_16b(tevs, TEVS_FLICK_CTRL, val);
-    }
-        break;
-	case V4L2_CID_WHITE_BALANCE_TEMPERATURE:
-        ret = tevs_i2c_write_16b(tevs, TEVS_AWB_MANUAL_TEMP,
-				        ctrl->val & TEVS_AWB_MANUAL_TEMP_MASK);
-        break;
-	case V4L2_CID_SHARPNESS:
-        ret = tevs_i2c_write_16b(tevs, TEVS_SHARPEN,
-				        ctrl->val & TEVS_SHARPEN_MASK);
-        break;
-	case V4L2_CID_BACKLIGHT_COMPENSATION:
-        ret = tevs_i2c_write_16b(tevs, TEVS_BACKLIGHT_COMPENSATION,
-				        ctrl->val & TEVS_BACKLIGHT_COMPENSATION_MASK);
-        break;
-	case V4L2_CID_COLORFX: {
-        u16 val;
-        switch (ctrl->val) {
-        case 0:
-            val = TEVS_SFX_MODE_SFX_NORMAL;
-            break;
-        case 1:
-            val = TEVS_SFX_MODE_SFX_BW;
-            break;
-        case 2:
-            val = TEVS_SFX_MODE_SFX_GRAYSCALE;
-            break;
-        case 3:
-            val = TEVS_SFX_MODE_SFX_NEGATIVE;
-            break;
-        case 4:
-            val = TEVS_SFX_MODE_SFX_SKETCH;
-            break;
-        default:
-            val = TEVS_SFX_MODE_SFX_NORMAL;
-            break;
-        }
-        ret = tevs_i2c_write_16b(tevs, TEVS_SFX_MODE, val);
-        break;
-    }
-	case V4L2_CID_EXPOSURE_AUTO: {
-        u16 val;
-        switch (ctrl->val) {
-        case 0:
-            val = TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN;
-            break;
-        case 1:
-            val = TEVS_AE_CTRL_FULL_AUTO;
-            break;
-        default:
-            val = TEVS_AE_CTRL_FULL_AUTO;
-            break;
-        }
-        ret = tevs_i2c_write_16b(tevs, TEVS_AE_CTRL_MODE, val);
-        break;
-    }
-	case V4L2_CID_PAN_ABSOLUTE:
-        ret = tevs_i2c_write_16b(tevs, TEVS_DZ_CT_X,
-				        ctrl->val & TEVS_DZ_CT_X_MASK);
-        break;
-	case V4L2_CID_TILT_ABSOLUTE:
-        ret = tevs_i2c_write_16b(tevs, TEVS_DZ_CT_Y,
-				        ctrl->val & TEVS_DZ_CT_Y_MASK);
-        break;
-	case V4L2_CID_ZOOM_ABSOLUTE:
-        ret = tevs_i2c_write_16b(tevs, TEVS_DZ_TGT_FCT,
-				        ctrl->val & TEVS_DZ_TGT_FCT_MASK);
-        break;
-	case V4L2_CID_TEVS_BSL_MODE: {
-    	u8 bootcmd[6] = {0x00, 0x12, 0x3A, 0x61, 0x44, 0xDE};
-        u8 startup[6] = {0x00, 0x40, 0xE2, 0x51, 0x21, 0x5B};
-        u8 tmp;
-        dev_dbg(&client->dev, "%s(): set bls mode: %d", __func__, ctrl->val);
-
-        switch (ctrl->val) {
-        case 0:
-            ret = tevs_i2c_write(tevs, 0x8001, startup, 6);
-            ret = tevs_i2c_read(tevs, 0x8001, &tmp, 1);
-            break;
-        case 1:
-			ret = regulator_bulk_disable(TEVS_NUM_SUPPLIES, tevs->supplies);
-            gpiod_set_value_cansleep(tevs->reset_gpio, 0);
-            usleep_range(9000, 10000);
-            gpiod_set_value_cansleep(tevs->standby_gpio, 1);
-            msleep(100);
-			ret = regulator_bulk_enable(TEVS_NUM_SUPPLIES, tevs->supplies);
-            gpiod_set_value_cansleep(tevs->reset_gpio, 1);
-            usleep_range(9000, 10000);
-            gpiod_set_value_cansleep(tevs->standby_gpio, 0);
-            msleep(100);
-            ret = tevs_i2c_write(tevs, 0x8001, bootcmd, 6);
-            msleep(100);
-            ret = tevs_i2c_read(tevs, 0x8001, &tmp, 1);
-            break;
-        default:
-            dev_err(&client->dev, "%s(): set err bls mode: %d", __func__, ctrl->val);
-            ret = -EINVAL;
-            break;
-        }
-        break;
-    }
-	default:
-		dev_dbg(&client->dev, "Unknown control 0x%x\n",
-			ctrl->id);
-		return -EINVAL;
+	if ((desc->flags & TEVS_CTRL_IDLE) && tevs->streaming)
+		return -EBUSY;
+	if (tevs_ctrl_held(tevs, desc))
+		return 0;
+
+	if (desc->set)
+		return desc->set(tevs, ctrl);
+
+	if (desc->state_size) {
+		tevs_ctrl_state_put(tevs, desc, ctrl->val);
+		/* Deferred to stream start while stopped */
+		if (!desc->apply || (!tevs->streaming && !tevs->ctrl_replay))
+			return 0;
+
+		return desc->apply(tevs);
 	}
 
-    return ret;
+	/* Written by tevs_ctrls_batch_write() */
+	if (!desc->reg || ((tevs->ctrl_replay || tevs->ctrl_bulk) &&
+			   tevs_ctrl_batched(desc)))
+		return 0;
+	if (tevs_ctrl_at_boot(tevs, desc, ctrl->val))
+		return 0;
+
+	if (tevs->cmdq.enabled && tevs_ctrl_batched(desc) &&
+	    tevs_cmdq_queue(tevs, ctrl))
+		return 0;
+
+	return tevs_ctrl_reg_write(tevs, desc, ctrl->val);
 }
 
 static int tevs_g_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct tevs *tevs = container_of(ctrl->handler, struct tevs, ctrls);
-	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
-	u16 val;
-	int ret;
+	const struct tevs_ctrl_desc *desc = ctrl->priv;
 
-	switch (ctrl->id) {
-	case V4L2_CID_BRIGHTNESS:
-        ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_BRIGHTNESS_MASK;
-        break;
-	case V4L2_CID_CONTRAST:
-        ret = tevs_i2c_read_16b(tevs, TEVS_CONTRAST, &val);
-        if (ret)
-            break;
-        ctrl->val = val & TEVS_CONTRAST_MASK;
-        break;
-	case V4L2_CID_SATURATION:
-        ret = tevs_i2c_read_16b(tevs, TEVS_SATURATION, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_SATURATION_MASK;
-        break;
-	case V4L2_CID_AUTO_WHITE_BALANCE:
-        ret = tevs_i2c_read_16b(tevs, TEVS_AWB_CTRL_MODE, &val);
-        if (ret)
-            break;
-
-        switch (val & TEVS_AWB_CTRL_MODE_MASK) {
-        case TEVS_AWB_CTRL_MODE_MANUAL_TEMP:
-            ctrl->val = 0;
-            break;
-        case TEVS_AWB_CTRL_MODE_AUTO:
-            ctrl->val = 1;
-            break;
-        default:
-            ctrl->val = 1;
-            break;
-        }
-        break;
-	case V4L2_CID_GAMMA:
-        ret = tevs_i2c_read_16b(tevs, TEVS_GAMMA, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_GAMMA_MASK;
-        break;
-	case V4L2_CID_EXPOSURE: {
-        u8 exp[4] = { 0 };
-        ret = tevs_i2c_read(tevs, TEVS_AE_MANUAL_EXP_TIME, exp, 4);
-        if (ret)
-            break;
-
-        ctrl->val = be32_to_cpup((__be32*)exp);
-        break;
-    }
-	case V4L2_CID_GAIN:
-        ret = tevs_i2c_read_16b(tevs, TEVS_AE_MANUAL_GAIN, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_AE_MANUAL_GAIN_MASK;
-        break;
-	case V4L2_CID_HFLIP:
-        ret = tevs_i2c_read_16b(tevs, TEVS_ORIENTATION, &val);
-        if (ret)
-            break;
-
-        ctrl->val = !!(val & TEVS_ORIENTATION_HFLIP);
-        break;
-	case V4L2_CID_VFLIP:
-        ret = tevs_i2c_read_16b(tevs, TEVS_ORIENTATION, &val);
-        if (ret)
-            break;
-
-        ctrl->val = !!(val & TEVS_ORIENTATION_VFLIP);
-        break;
-	case V4L2_CID_POWER_LINE_FREQUENCY:
-        ret = tevs_i2c_read_16b(tevs, TEVS_FLICK_CTRL, &val);
-        if (ret)
-            break;
-
-        switch (val & TEVS_FLICK_CTRL_MODE_MASK)
-        {
-        case TEVS_FLICK_CTRL_MODE_DISABLED:
-            ctrl->val = 0;
-            break;
-        case TEVS_FLICK_CTRL_MODE_MANUAL:
-            if((val & TEVS_FLICK_CTRL_FREQ_MASK) == TEVS_FLICK_CTRL_FREQ(50))
-                ctrl->val = 1;
-            else if((val & TEVS_FLICK_CTRL_FREQ_MASK)  == TEVS_FLICK_CTRL_FREQ(60))
-                ctrl->val = 2;
-            break;
-        case TEVS_FLICK_CTRL_MODE_AUTO:
-            ctrl->val = 3;
-            break;
-        default:
-            ctrl->val = 0;
-            break;
-        }
-        break;
-	case V4L2_CID_WHITE_BALANCE_TEMPERATURE:
-        ret = tevs_i2c_read_16b(tevs, TEVS_AWB_MANUAL_TEMP, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_AWB_MANUAL_TEMP_MASK;
-        break;
-	case V4L2_CID_SHARPNESS:
-        ret = tevs_i2c_read_16b(tevs, TEVS_SHARPEN, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_SHARPEN_MASK;
-        break;
-	case V4L2_CID_BACKLIGHT_COMPENSATION:
-        ret = tevs_i2c_read_16b(tevs, TEVS_BACKLIGHT_COMPENSATION, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_BACKLIGHT_COMPENSATION_MASK;
-        break;
-	case V4L2_CID_COLORFX:    
-        ret = tevs_i2c_read_16b(tevs, TEVS_SFX_MODE, &val);
-        if (ret)
-            break;
-
-        switch (val & TEVS_SFX_MODE_SFX_MASK) {
-        case TEVS_SFX_MODE_SFX_NORMAL:
-            ctrl->val = 0;
-            break;
-        case TEVS_SFX_MODE_SFX_BW:
-            ctrl->val = 1;
-            break;
-        case TEVS_SFX_MODE_SFX_GRAYSCALE:
-            ctrl->val = 2;
-            break;
-        case TEVS_SFX_MODE_SFX_NEGATIVE:
-            ctrl->val = 3;
-            break;
-        case TEVS_SFX_MODE_SFX_SKETCH:
-            ctrl->val = 4;
-            break;
-        default:
-            ctrl->val = 0;
-            break;
-        }
-        break;
-	case V4L2_CID_EXPOSURE_AUTO:
-        ret = tevs_i2c_read_16b(tevs, TEVS_AE_CTRL_MODE, &val);
-        if (ret)
-            break;
-
-        switch (val & TEVS_AE_CTRL_MODE_MASK) {
-        case TEVS_AE_CTRL_MANUAL_EXP_TIME_GAIN:
-            ctrl->val = 0;
-            break;
-        case TEVS_AE_CTRL_FULL_AUTO:
-            ctrl->val = 1;
-            break;
-        default:
-            ctrl->val = 1;
-            break;
-        }
-        break;
-	case V4L2_CID_PAN_ABSOLUTE:
-        ret = tevs_i2c_read_16b(tevs, TEVS_DZ_CT_X, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_DZ_CT_X_MASK;
-        break;
-	case V4L2_CID_TILT_ABSOLUTE:
-        ret = tevs_i2c_read_16b(tevs, TEVS_DZ_CT_Y, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_DZ_CT_Y_MASK;
-        break;
-	case V4L2_CID_ZOOM_ABSOLUTE:
-        ret = tevs_i2c_read_16b(tevs, TEVS_DZ_TGT_FCT, &val);
-        if (ret)
-            break;
-
-        ctrl->val = val & TEVS_DZ_TGT_FCT_MASK;
-        break;
-	case V4L2_CID_TEVS_BSL_MODE:
-		// ctrl->val = 0;
-		// dev_info(tevs->dev, "get tevs flash mode: %d", ctrl->val);
+	if (desc->get)
+		return desc->get(tevs, ctrl);
+
+	if (desc->state_size) {
+		ctrl->val = tevs_ctrl_state_get(tevs, desc);
 		return 0;
-	default:
-		dev_dbg(&client->dev, "Unknown control 0x%x\n",
-			ctrl->id);
-		return -EINVAL;
 	}
 
-    return ret;
+	if (!desc->reg)
+		return 0;
+
+	return tevs_ctrl_reg_read(tevs, desc, &ctrl->val);
+}
+
+static int tevs_subscribe_event(struct v4l2_subdev *sub_dev,
+				struct v4l2_fh *fh,
+				struct v4l2_event_subscription *sub)
+{
+	struct tevs *tevs = to_tevs(sub_dev);
+
+	switch (sub->type) {
+	case V4L2_EVENT_FRAME_SYNC:
+		/* Frame starts derived from the frame rate are not reported */
+		if (!tevs->frame_sync_gpio)
+			return -EINVAL;
+		return v4l2_event_subscribe(fh, sub, TEVS_EVENT_QUEUE_DEPTH,
+					    NULL);
+	case TEVS_EVENT_BRACKET:
+	case TEVS_EVENT_SHUTTER:
+	case TEVS_EVENT_TRIGGER:
+	case TEVS_EVENT_AE_CONVERGED:
+	case TEVS_EVENT_STILL:
+	case TEVS_EVENT_STREAM:
+	case TEVS_EVENT_RECOVERY:
+		return v4l2_event_subscribe(fh, sub, TEVS_EVENT_QUEUE_DEPTH,
+					    NULL);
+	case V4L2_EVENT_SOURCE_CHANGE:
+		return v4l2_src_change_event_subdev_subscribe(sub_dev, fh, sub);
+	default:
+		return v4l2_ctrl_subdev_subscribe_event(sub_dev, fh, sub);
+	}
 }
 
 static const struct v4l2_subdev_core_ops tevs_v4l2_subdev_core_ops = {
 	// .s_power = tevs_power,
-	.subscribe_event = v4l2_ctrl_subdev_subscribe_event,
+	.subscribe_event = tevs_subscribe_event,
 	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
@@ -1487,211 +4284,1392 @@ static const struct v4l2_subdev_internal_ops tevs_internal_ops = {
 };
 
 static const struct v4l2_ctrl_ops tevs_ctrl_ops = {
+	.g_volatile_ctrl = tevs_g_ctrl,
 	.s_ctrl = tevs_s_ctrl,
 };
 
-static const struct v4l2_ctrl_config tevs_ctrls[] = {
+static const struct tevs_ctrl_desc tevs_ctrls[] = {
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_BRIGHTNESS,
+			.name = "Brightness",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_BRIGHTNESS,
+		.width = 2,
+		.mask = TEVS_BRIGHTNESS_MASK,
+		.max_reg = TEVS_BRIGHTNESS_MAX,
+		.min_reg = TEVS_BRIGHTNESS_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_CONTRAST,
+			.name = "Contrast",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_CONTRAST,
+		.width = 2,
+		.mask = TEVS_CONTRAST_MASK,
+		.max_reg = TEVS_CONTRAST_MAX,
+		.min_reg = TEVS_CONTRAST_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_SATURATION,
+			.name = "Saturation",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_SATURATION,
+		.width = 2,
+		.mask = TEVS_SATURATION_MASK,
+		.max_reg = TEVS_SATURATION_MAX,
+		.min_reg = TEVS_SATURATION_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_AUTO_WHITE_BALANCE,
+			.name = "White_Balance_Mode",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_AWB_CTRL_MODE_AUTO_IDX,
+			.def = TEVS_AWB_CTRL_MODE_AUTO_IDX,
+			.qmenu = awb_mode_strings,
+		},
+		.reg = TEVS_AWB_CTRL_MODE,
+		.width = 2,
+		.mask = TEVS_AWB_CTRL_MODE_MASK,
+		.menu = tevs_awb_modes,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_GAMMA,
+			.name = "Gamma",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x2333, // 2.2
+		},
+		.reg = TEVS_GAMMA,
+		.width = 2,
+		.mask = TEVS_GAMMA_MASK,
+		.max_reg = TEVS_GAMMA_MAX,
+		.min_reg = TEVS_GAMMA_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_EXPOSURE,
+			.name = "Exposure",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xF4240,
+			.step = 1,
+			.def = 0x8235, // 33333 us
+		},
+		.reg = TEVS_AE_MANUAL_EXP_TIME,
+		.width = 4,
+		.mask = TEVS_AE_MANUAL_EXP_TIME_MASK,
+		.max_reg = TEVS_AE_MANUAL_EXP_TIME_MAX,
+		.min_reg = TEVS_AE_MANUAL_EXP_TIME_MIN,
+		.flags = TEVS_CTRL_AE | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_GAIN,
+			.name = "Gain",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x1,
+			.max = 0x40,
+			.step = 0x1,
+			.def = 0x1,
+		},
+		.reg = TEVS_AE_MANUAL_GAIN,
+		.width = 2,
+		.mask = TEVS_AE_MANUAL_GAIN_MASK,
+		.max_reg = TEVS_AE_MANUAL_GAIN_MAX,
+		.min_reg = TEVS_AE_MANUAL_GAIN_MIN,
+		.flags = TEVS_CTRL_AE | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_HFLIP,
+			.name = "HFlip",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		.reg = TEVS_ORIENTATION,
+		.width = 2,
+		.mask = TEVS_ORIENTATION_HFLIP,
+		.flags = TEVS_CTRL_FIELD | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_VFLIP,
+			.name = "VFlip",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		.reg = TEVS_ORIENTATION,
+		.width = 2,
+		.mask = TEVS_ORIENTATION_VFLIP,
+		.flags = TEVS_CTRL_FIELD | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_POWER_LINE_FREQUENCY,
+			.name = "Power_Line_Frequency",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_FLICK_MODE_ENABLED_IDX,
+			.def = TEVS_FLICK_MODE_DISABLED_IDX,
+			.qmenu = flick_mode_strings,
+		},
+		.flags = TEVS_CTRL_PRESET,
+		.set = tevs_ctrl_set_flicker,
+		.get = tevs_ctrl_get_flicker,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_WHITE_BALANCE_TEMPERATURE,
+			.name = "White_Balance_Temperature",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x8FC,
+			.max = 0x3A98,
+			.step = 0x1,
+			.def = 0x1388,
+		},
+		.reg = TEVS_AWB_MANUAL_TEMP,
+		.width = 2,
+		.mask = TEVS_AWB_MANUAL_TEMP_MASK,
+		.max_reg = TEVS_AWB_MANUAL_TEMP_MAX,
+		.min_reg = TEVS_AWB_MANUAL_TEMP_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_SHARPNESS,
+			.name = "Sharpness",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_SHARPEN,
+		.width = 2,
+		.mask = TEVS_SHARPEN_MASK,
+		.max_reg = TEVS_SHARPEN_MAX,
+		.min_reg = TEVS_SHARPEN_MIN,
+		.flags = TEVS_CTRL_ISP | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_BACKLIGHT_COMPENSATION,
+			.name = "Backlight_Compensation",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_BACKLIGHT_COMPENSATION,
+		.width = 2,
+		.mask = TEVS_BACKLIGHT_COMPENSATION_MASK,
+		.max_reg = TEVS_BACKLIGHT_COMPENSATION_MAX,
+		.min_reg = TEVS_BACKLIGHT_COMPENSATION_MIN,
+		.flags = TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_COLORFX,
+			.name = "Special_Effect",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_SFX_MODE_SFX_SKETCH_IDX,
+			.def = TEVS_SFX_MODE_SFX_NORMAL_IDX,
+			.qmenu = sfx_mode_strings,
+		},
+		.reg = TEVS_SFX_MODE,
+		.width = 2,
+		.mask = TEVS_SFX_MODE_SFX_MASK,
+		.menu = tevs_sfx_modes,
+		.flags = TEVS_CTRL_ISP | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_EXPOSURE_AUTO,
+			.name = "Exposure_Mode",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_AE_CTRL_FULL_AUTO_IDX,
+			.def = TEVS_AE_CTRL_FULL_AUTO_IDX,
+			.qmenu = ae_mode_strings,
+		},
+		.reg = TEVS_AE_CTRL_MODE,
+		.width = 2,
+		.mask = TEVS_AE_CTRL_MODE_MASK,
+		.menu = tevs_ae_modes,
+		.flags = TEVS_CTRL_AE | TEVS_CTRL_PRESET,
+		.set = tevs_ctrl_set_ae,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_PAN_ABSOLUTE,
+			.name = "Pan_Target",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_DZ_CT_X,
+		.width = 2,
+		.mask = TEVS_DZ_CT_X_MASK,
+		.max_reg = TEVS_DZ_CT_MAX,
+		.min_reg = TEVS_DZ_CT_MIN,
+		.flags = TEVS_CTRL_PRESET,
+		.set = tevs_ctrl_set_eptz_axis,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TILT_ABSOLUTE,
+			.name = "Tilt_Target",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_DZ_CT_Y,
+		.width = 2,
+		.mask = TEVS_DZ_CT_Y_MASK,
+		.max_reg = TEVS_DZ_CT_MAX,
+		.min_reg = TEVS_DZ_CT_MIN,
+		.flags = TEVS_CTRL_PRESET,
+		.set = tevs_ctrl_set_eptz_axis,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_ZOOM_ABSOLUTE,
+			.name = "Zoom_Target",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_DZ_TGT_FCT,
+		.width = 2,
+		.mask = TEVS_DZ_TGT_FCT_MASK,
+		.max_reg = TEVS_DZ_TGT_FCT_MAX,
+		.min_reg = TEVS_DZ_TGT_FCT_MIN,
+		.flags = TEVS_CTRL_PRESET,
+		.set = tevs_ctrl_set_eptz_axis,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_BSL_MODE,
+			.name = "BSL_Mode",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_BSL_MODE_FLASH_IDX,
+			.def = TEVS_BSL_MODE_NORMAL_IDX,
+			.qmenu = bsl_mode_strings,
+		},
+		.set = tevs_ctrl_set_bsl,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_BRACKET_SEQ,
+			.name = "Bracket_Sequence",
+			.type = V4L2_CTRL_TYPE_U32,
+			.min = 0x0,
+			.max = 0xF4240,
+			.step = 0x1,
+			.def = 0x0,
+			.dims = { TEVS_BRACKET_MAX_STEPS, 2 },
+		},
+		.set = tevs_ctrl_set_bracket_seq,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_BRACKET_COUNT,
+			.name = "Bracket_Count",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = TEVS_BRACKET_MAX_STEPS,
+			.step = 1,
+			.def = 0,
+		},
+		.set = tevs_ctrl_set_bracket_count,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_BRACKET_INDEX,
+			.name = "Bracket_Index",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = -1,
+			.max = TEVS_BRACKET_MAX_STEPS - 1,
+			.step = 1,
+			.def = -1,
+		},
+		TEVS_CTRL_STATE(bracket.index),
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_EPTZ,
+			.name = "ePTZ_Target",
+			.type = V4L2_CTRL_TYPE_U32,
+			.flags = V4L2_CTRL_FLAG_VOLATILE |
+				 V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+			.dims = { TEVS_EPTZ_AXES },
+		},
+		.set = tevs_ctrl_set_eptz,
+		.get = tevs_ctrl_get_eptz,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_EPTZ_FRAMES,
+			.name = "ePTZ_Trajectory_Frames",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = TEVS_EPTZ_MAX_FRAMES,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(eptz.frames),
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_WIDE_DYNAMIC_RANGE,
+			.name = "HDR_Mode",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		.reg = TEVS_FLICK_CTRL,
+		.width = 2,
+		.mask = TEVS_FLICK_CTRL_ETC_IHDR_UP,
+		.flags = TEVS_CTRL_FIELD,
+		.set = tevs_ctrl_set_hdr,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_EXPOSURE_AUTO_PRIORITY,
+			.name = "Exposure_Auto_Priority",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 1,
+		},
+		.flags = TEVS_CTRL_PRESET,
+		TEVS_CTRL_STATE(ae_priority),
+		.apply = tevs_ae_limit_apply,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_AE_MAX_EXPOSURE,
+			.name = "AE_Max_Exposure",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xF4240,
+			.step = 1,
+			.def = 0x0,
+		},
+		.flags = TEVS_CTRL_PRESET,
+		TEVS_CTRL_STATE(ae_max_exposure),
+		.apply = tevs_ae_limit_apply,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_CSI_THROUGHPUT,
+			.name = "CSI_Throughput",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = TEVS_CSI_THROUGHPUT_MAX,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(throughput),
+		.set = tevs_ctrl_set_throughput,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_PIXEL_RATE,
+			.name = "Pixel_Rate",
+			.type = V4L2_CTRL_TYPE_INTEGER64,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 1,
+			.max = 0x7FFFFFFF,
+			.step = 1,
+			.def = 1,
+		},
+		.get = tevs_ctrl_get_pixel_rate,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_DENOISE,
+			.name = "Denoise",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0x0,
+			.max = 0xFFFF,
+			.step = 0x1,
+			.def = 0x0,
+		},
+		.reg = TEVS_DENOISE,
+		.width = 2,
+		.mask = TEVS_DENOISE_MASK,
+		.max_reg = TEVS_DENOISE_MAX,
+		.min_reg = TEVS_DENOISE_MIN,
+		.flags = TEVS_CTRL_ISP | TEVS_CTRL_PRESET,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_LATENCY_PROFILE,
+			.name = "Latency_Profile",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_LATENCY_PROFILE_LOW_IDX,
+			.def = TEVS_LATENCY_PROFILE_DEFAULT_IDX,
+			.qmenu = latency_profile_strings,
+		},
+		.flags = TEVS_CTRL_PRESET,
+		TEVS_CTRL_STATE(low_latency),
+		.apply = tevs_latency_profile_apply,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_MODE,
+			.name = "Trigger_Mode",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		.flags = TEVS_CTRL_IDLE,
+		TEVS_CTRL_STATE(trigger_mode),
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_SOFTWARE_TRIGGER,
+			.name = "Software_Trigger",
+			.type = V4L2_CTRL_TYPE_BUTTON,
+		},
+		.set = tevs_ctrl_set_software_trigger,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_SYNC_ROLE,
+			.name = "Sync_Role",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_SYNC_ROLE_SLAVE,
+			.def = TEVS_SYNC_ROLE_FREE_RUN,
+			.qmenu = sync_role_strings,
+		},
+		.flags = TEVS_CTRL_IDLE,
+		TEVS_CTRL_STATE(sync_role),
+		.set = tevs_ctrl_set_sync_role,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_SYNC_SKEW,
+			.name = "Sync_Skew_us",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = -TEVS_SYNC_SKEW_MAX,
+			.max = TEVS_SYNC_SKEW_MAX,
+			.step = 1,
+			.def = 0,
+		},
+		.get = tevs_ctrl_get_sync_skew,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_PERIOD,
+			.name = "Trigger_Period_us",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = TEVS_TRIGGER_PERIOD_MAX,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(trigger_period),
+		.set = tevs_ctrl_set_trigger,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_PULSE,
+			.name = "Trigger_Pulse_us",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 1,
+			.max = TEVS_TRIGGER_PULSE_MAX,
+			.step = 1,
+			.def = TEVS_TRIGGER_PULSE_US,
+		},
+		TEVS_CTRL_STATE(trigger_pulse),
+		.set = tevs_ctrl_set_trigger,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_COUNT,
+			.name = "Trigger_Count",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = 0x7FFFFFFF,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(trigger_count),
+		.set = tevs_ctrl_set_trigger,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_GROUP,
+			.name = "Trigger_Group",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = TEVS_TRIGGER_GROUP_MAX,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(trigger_group),
+		.set = tevs_ctrl_set_trigger,
+	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_BRIGHTNESS,
-		.name = "Brightness",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_TRIGGER_MISSED,
+			.name = "Trigger_Missed",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 0,
+			.max = 0x7FFFFFFF,
+			.step = 1,
+			.def = 0,
+		},
+		.get = tevs_ctrl_get_trigger_missed,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_CONTRAST,
-		.name = "Contrast",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_LED_MODE,
+			.name = "Flash_LED_Mode",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = V4L2_FLASH_LED_MODE_TORCH,
+			.def = V4L2_FLASH_LED_MODE_NONE,
+		},
+		TEVS_CTRL_STATE(flash_led_mode),
+		.set = tevs_ctrl_set_flash_mode,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_SATURATION,
-		.name = "Saturation",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_STROBE_SOURCE,
+			.name = "Flash_Strobe_Source",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = V4L2_FLASH_STROBE_SOURCE_EXTERNAL,
+			.def = V4L2_FLASH_STROBE_SOURCE_EXTERNAL,
+		},
+		TEVS_CTRL_STATE(strobe_source),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_AUTO_WHITE_BALANCE,
-		.name = "White_Balance_Mode",
-		.type = V4L2_CTRL_TYPE_MENU,
-		.max = TEVS_AWB_CTRL_MODE_AUTO_IDX,
-		.def = TEVS_AWB_CTRL_MODE_AUTO_IDX,
-		.qmenu = awb_mode_strings,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_TIMEOUT,
+			.name = "Flash_Strobe_Duration_us",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 1,
+			.max = TEVS_STROBE_DURATION_MAX,
+			.step = 1,
+			.def = TEVS_STROBE_DURATION_DEF,
+		},
+		TEVS_CTRL_STATE(strobe_duration),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_GAMMA,
-		.name = "Gamma",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x2333, // 2.2
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STROBE_MODE,
+			.name = "Flash_Strobe_Mode",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_STROBE_MODE_ON_TRIGGER,
+			.def = TEVS_STROBE_MODE_EVERY_FRAME,
+			.qmenu = strobe_mode_strings,
+		},
+		TEVS_CTRL_STATE(strobe_mode),
+		.set = tevs_ctrl_set_strobe_mode,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_EXPOSURE,
-		.name = "Exposure",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xF4240,
-		.step = 1,
-		.def = 0x8235, // 33333 us
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STROBE_INTERVAL,
+			.name = "Flash_Strobe_Interval",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 1,
+			.max = TEVS_STROBE_INTERVAL_MAX,
+			.step = 1,
+			.def = 1,
+		},
+		TEVS_CTRL_STATE(strobe_interval),
+		.set = tevs_ctrl_set_strobe_mode,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_GAIN,
-		.name = "Gain",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x1,
-		.max = 0x40,
-		.step = 0x1,
-		.def = 0x1,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_STROBE,
+			.name = "Flash_Strobe",
+			.type = V4L2_CTRL_TYPE_BUTTON,
+		},
+		.set = tevs_ctrl_set_strobe,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_HFLIP,
-		.name = "HFlip",
-		.type = V4L2_CTRL_TYPE_BOOLEAN,
-		.min = 0,
-		.max = 1,
-		.step = 1,
-		.def = 0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_STROBE_STOP,
+			.name = "Flash_Strobe_Stop",
+			.type = V4L2_CTRL_TYPE_BUTTON,
+		},
+		.set = tevs_ctrl_set_strobe_stop,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_VFLIP,
-		.name = "VFlip",
-		.type = V4L2_CTRL_TYPE_BOOLEAN,
-		.min = 0,
-		.max = 1,
-		.step = 1,
-		.def = 0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_FLASH_STROBE_STATUS,
+			.name = "Flash_Strobe_Status",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(strobe_on),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_POWER_LINE_FREQUENCY,
-		.name = "Power_Line_Frequency",
-		.type = V4L2_CTRL_TYPE_MENU,
-		.max = TEVS_FLICK_MODE_ENABLED_IDX,
-		.def = TEVS_FLICK_MODE_DISABLED_IDX,
-		.qmenu = flick_mode_strings,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_AE_SEED,
+			.name = "AE_Seed",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 1,
+		},
+		TEVS_CTRL_STATE(seed.enabled),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_WHITE_BALANCE_TEMPERATURE,
-		.name = "White_Balance_Temperature",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x8FC,
-		.max = 0x3A98,
-		.step = 0x1,
-		.def = 0x1388,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_AE_CONVERGED,
+			.name = "AE_Converged",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(converge.converged),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_SHARPNESS,
-		.name = "Sharpness",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STILL_MODE,
+			.name = "Still_Mode",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 0,
+			.max = 0xFF,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(still.mode),
+		.set = tevs_ctrl_set_still,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_BACKLIGHT_COMPENSATION,
-		.name = "Backlight_Compensation",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STILL_FRAMES,
+			.name = "Still_Frames",
+			.type = V4L2_CTRL_TYPE_INTEGER,
+			.min = 1,
+			.max = TEVS_STILL_MAX_FRAMES,
+			.step = 1,
+			.def = 1,
+		},
+		TEVS_CTRL_STATE(still.frames),
+		.set = tevs_ctrl_set_still,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_COLORFX,
-		.name = "Special_Effect",
-		.type = V4L2_CTRL_TYPE_MENU,
-		.max = TEVS_SFX_MODE_SFX_SKETCH_IDX,
-		.def = TEVS_SFX_MODE_SFX_NORMAL_IDX,
-		.qmenu = sfx_mode_strings,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STILL_CAPTURE,
+			.name = "Still_Capture",
+			.type = V4L2_CTRL_TYPE_BUTTON,
+		},
+		.set = tevs_ctrl_set_still_capture,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_EXPOSURE_AUTO,
-		.name = "Exposure_Mode",
-		.type = V4L2_CTRL_TYPE_MENU,
-		.max = TEVS_AE_CTRL_FULL_AUTO_IDX,
-		.def = TEVS_AE_CTRL_FULL_AUTO_IDX,
-		.qmenu = ae_mode_strings,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_STREAM_ASYNC,
+			.name = "Stream_Async",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(stream_async),
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_PAN_ABSOLUTE,
-		.name = "Pan_Target",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_CTRL_QUEUE,
+			.name = "Ctrl_Queue",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 0,
+		},
+		TEVS_CTRL_STATE(cmdq.enabled),
+		.set = tevs_ctrl_set_cmdq,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_TILT_ABSOLUTE,
-		.name = "Tilt_Target",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_CTRL_QUEUE_STATS,
+			.name = "Ctrl_Queue_Stats",
+			.type = V4L2_CTRL_TYPE_U32,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 0,
+			.max = 0xFFFFFFFF,
+			.step = 1,
+			.def = 0,
+			.dims = { TEVS_CMDQ_STATS },
+		},
+		.get = tevs_ctrl_get_cmdq_stats,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_ZOOM_ABSOLUTE,
-		.name = "Zoom_Target",
-		.type = V4L2_CTRL_TYPE_INTEGER,
-		.min = 0x0,
-		.max = 0xFFFF,
-		.step = 0x1,
-		.def = 0x0,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_PRESET_SAVE,
+			.name = "Preset_Save",
+			.type = V4L2_CTRL_TYPE_STRING,
+			.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+			.min = 0,
+			.max = TEVS_PRESET_NAME_LEN - 1,
+			.step = 1,
+		},
+		.set = tevs_ctrl_set_preset,
 	},
 	{
-		.ops = &tevs_ctrl_ops,
-		.id = V4L2_CID_TEVS_BSL_MODE,
-		.name = "BSL_Mode",
-		.type = V4L2_CTRL_TYPE_MENU,
-		.max = TEVS_BSL_MODE_FLASH_IDX,
-		.def = TEVS_BSL_MODE_NORMAL_IDX,
-		.qmenu = bsl_mode_strings,
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_PRESET_APPLY,
+			.name = "Preset_Apply",
+			.type = V4L2_CTRL_TYPE_STRING,
+			.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+			.min = 0,
+			.max = TEVS_PRESET_NAME_LEN - 1,
+			.step = 1,
+		},
+		.set = tevs_ctrl_set_preset,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_PRESET_DELETE,
+			.name = "Preset_Delete",
+			.type = V4L2_CTRL_TYPE_STRING,
+			.flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+			.min = 0,
+			.max = TEVS_PRESET_NAME_LEN - 1,
+			.step = 1,
+		},
+		.set = tevs_ctrl_set_preset,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_PRESET_LIST,
+			.name = "Preset_List",
+			.type = V4L2_CTRL_TYPE_STRING,
+			.flags = V4L2_CTRL_FLAG_VOLATILE | V4L2_CTRL_FLAG_READ_ONLY,
+			.min = 0,
+			.max = TEVS_PRESET_SLOTS * TEVS_PRESET_NAME_LEN - 1,
+			.step = 1,
+		},
+		.get = tevs_ctrl_get_preset_list,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEVS_WATCHDOG,
+			.name = "Stream_Watchdog",
+			.type = V4L2_CTRL_TYPE_BOOLEAN,
+			.min = 0,
+			.max = 1,
+			.step = 1,
+			.def = 1,
+		},
+		TEVS_CTRL_STATE(watchdog.enabled),
+		.apply = tevs_watchdog_apply,
+	},
+	{
+		.cfg = {
+			.ops = &tevs_ctrl_ops,
+			.id = V4L2_CID_TEST_PATTERN,
+			.name = "Test_Pattern",
+			.type = V4L2_CTRL_TYPE_MENU,
+			.max = TEVS_TEST_PATTERN_COUNTER,
+			.def = TEVS_TEST_PATTERN_DISABLED,
+			.qmenu = test_pattern_strings,
+		},
+		TEVS_CTRL_STATE(test_pattern),
+		.apply = tevs_test_pattern_apply,
 	},
 };
 
-static int tevs_ctrls_init(struct tevs *tevs)
+/* Builds and writes the register image of the batched controls */
+static int tevs_ctrls_batch_write(struct tevs *tevs)
+{
+	u8 image[TEVS_CTRL_IMAGE_SIZE];
+	DECLARE_BITMAP(valid, TEVS_CTRL_IMAGE_SIZE);
+	const struct tevs_ctrl_desc *desc;
+	struct v4l2_ctrl *ctrl;
+	unsigned int i;
+
+	/* Everything queued is part of the image */
+	tevs->cmdq.depth = 0;
+
+	bitmap_zero(valid, TEVS_CTRL_IMAGE_SIZE);
+	for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++) {
+		desc = &tevs_ctrls[i];
+		if (!tevs_ctrl_batched(desc) || tevs_ctrl_held(tevs, desc))
+			continue;
+
+		/* v4l2_ctrl_find() would take tevs->mutex again */
+		ctrl = tevs->ctrl_list[i];
+		if (ctrl && !tevs_ctrl_at_boot(tevs, desc, ctrl->cur.val))
+			tevs_ctrl_image_add(image, valid, ctrl);
+	}
+
+	return tevs_ctrl_image_write(tevs, image, valid, NULL);
+}
+
+/*
+ * Control presets. A slot holds the values of the TEVS_CTRL_PRESET controls
+ * under a name. Applying it sets all of them at once, the plain registers
+ * going out in a single tevs_ctrls_batch_write() burst, so the output does
+ * not step through a mix of the old and new values. While the stream is
+ * stopped the ISP may be powered off, the values are only noted then and
+ * the stream setup writes them.
+ */
+static struct tevs_preset *tevs_preset_find(struct tevs *tevs,
+					    const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < TEVS_PRESET_SLOTS; i++)
+		if (!strncmp(tevs->presets[i].name, name, TEVS_PRESET_NAME_LEN))
+			return &tevs->presets[i];
+
+	return NULL;
+}
+
+/* Called with tevs->mutex held, v4l2_ctrl_find() would take it again */
+static struct v4l2_ctrl *tevs_preset_ctrl(struct tevs *tevs, u32 id)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++)
+		if (tevs_ctrls[i].cfg.id == id &&
+		    (tevs_ctrls[i].flags & TEVS_CTRL_PRESET))
+			return tevs->ctrl_list[i];
+
+	return NULL;
+}
+
+static int tevs_preset_save(struct tevs *tevs, const char *name)
+{
+	struct tevs_preset *preset;
+	struct v4l2_ctrl *ctrl;
+	unsigned int i;
+
+	/* Overwrites a preset of the same name, else takes a free slot */
+	preset = tevs_preset_find(tevs, name) ?: tevs_preset_find(tevs, "");
+	if (!preset)
+		return -ENOSPC;
+
+	strscpy(preset->name, name, sizeof(preset->name));
+	preset->count = 0;
+	for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++) {
+		ctrl = tevs->ctrl_list[i];
+		if (!ctrl || !(tevs_ctrls[i].flags & TEVS_CTRL_PRESET))
+			continue;
+		if (WARN_ON(preset->count == TEVS_PRESET_CTRLS))
+			break;
+
+		preset->ctrls[preset->count].id = ctrl->id;
+		preset->ctrls[preset->count].val = ctrl->cur.val;
+		preset->count++;
+	}
+
+	return 0;
+}
+
+static int tevs_preset_write(struct tevs *tevs,
+			     const struct tevs_preset *preset)
+{
+	const struct tevs_ctrl_desc *desc;
+	struct v4l2_ctrl *ctrl;
+	bool viewport = false;
+	unsigned int i;
+	int ret = 0;
+
+	tevs->ctrl_bulk = true;
+	for (i = 0; i < preset->count && !ret; i++) {
+		ctrl = tevs_preset_ctrl(tevs, preset->ctrls[i].id);
+		desc = ctrl->priv;
+		if (desc->set == tevs_ctrl_set_eptz_axis)
+			viewport = true;
+
+		ret = __v4l2_ctrl_s_ctrl(ctrl, preset->ctrls[i].val);
+	}
+	tevs->ctrl_bulk = false;
+	if (ret || !tevs->streaming)
+		return ret;
+
+	if (viewport) {
+		ret = tevs_eptz_write(tevs, tevs->eptz.pos);
+		if (ret)
+			return ret;
+	}
+
+	return tevs_ctrls_batch_write(tevs);
+}
+
+static int tevs_preset_apply(struct tevs *tevs, const char *name)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	const struct tevs_preset *preset;
+	struct tevs_preset prev;
+	struct v4l2_ctrl *ctrl;
 	unsigned int i;
+	s32 val;
+	int ret;
+
+	preset = tevs_preset_find(tevs, name);
+	if (!preset)
+		return -ENOENT;
+
+	/* Checked up front so a preset is applied whole or not at all */
+	for (i = 0; i < preset->count; i++) {
+		ctrl = tevs_preset_ctrl(tevs, preset->ctrls[i].id);
+		val = preset->ctrls[i].val;
+		if (!ctrl)
+			return -EINVAL;
+		if (val < ctrl->minimum || val > ctrl->maximum)
+			return -ERANGE;
+		if (ctrl->type == V4L2_CTRL_TYPE_MENU &&
+		    (ctrl->menu_skip_mask & BIT_ULL(val)))
+			return -EINVAL;
+
+		prev.ctrls[i].id = ctrl->id;
+		prev.ctrls[i].val = ctrl->cur.val;
+	}
+	prev.count = preset->count;
+
+	/* A failed transfer leaves part of the preset, go back to before */
+	ret = tevs_preset_write(tevs, preset);
+	if (ret && tevs_preset_write(tevs, &prev))
+		dev_err(&client->dev, "failed to restore controls after %d\n",
+			ret);
+
+	return ret;
+}
+
+static int tevs_preset_delete(struct tevs *tevs, const char *name)
+{
+	struct tevs_preset *preset;
+
+	preset = tevs_preset_find(tevs, name);
+	if (!preset)
+		return -ENOENT;
+
+	memset(preset, 0, sizeof(*preset));
+
+	return 0;
+}
+
+static struct tevs *tevs_from_kobj(struct kobject *kobj)
+{
+	struct i2c_client *client = to_i2c_client(kobj_to_dev(kobj));
+
+	return to_tevs(i2c_get_clientdata(client));
+}
+
+static ssize_t presets_read(struct file *file, struct kobject *kobj,
+			    struct bin_attribute *attr, char *buf, loff_t off,
+			    size_t count)
+{
+	struct tevs *tevs = tevs_from_kobj(kobj);
+	const struct tevs_preset *preset;
+	struct tevs_preset_blob *blob;
+	unsigned int i, j;
+	ssize_t ret;
+
+	blob = kzalloc(sizeof(*blob), GFP_KERNEL);
+	if (!blob)
+		return -ENOMEM;
+
+	blob->magic = cpu_to_le32(TEVS_PRESET_MAGIC);
+	blob->version = cpu_to_le32(TEVS_PRESET_VERSION);
+	mutex_lock(&tevs->mutex);
+	for (i = 0; i < TEVS_PRESET_SLOTS; i++) {
+		preset = &tevs->presets[i];
+		memcpy(blob->slots[i].name, preset->name, sizeof(preset->name));
+		blob->slots[i].count = cpu_to_le32(preset->count);
+		for (j = 0; j < preset->count; j++) {
+			blob->slots[i].ctrls[j].id =
+				cpu_to_le32(preset->ctrls[j].id);
+			blob->slots[i].ctrls[j].val =
+				cpu_to_le32(preset->ctrls[j].val);
+		}
+	}
+	mutex_unlock(&tevs->mutex);
+
+	ret = memory_read_from_buffer(buf, count, &off, blob, sizeof(*blob));
+	kfree(blob);
+
+	return ret;
+}
+
+/* Replaces all slots, the blob is taken whole in a single write */
+static ssize_t presets_write(struct file *file, struct kobject *kobj,
+			     struct bin_attribute *attr, char *buf, loff_t off,
+			     size_t count)
+{
+	struct tevs *tevs = tevs_from_kobj(kobj);
+	const struct tevs_preset_blob *blob = (const void *)buf;
+	struct tevs_preset *presets, *preset;
+	unsigned int i, j;
+	ssize_t ret = count;
+
+	if (off || count != sizeof(*blob) ||
+	    le32_to_cpu(blob->magic) != TEVS_PRESET_MAGIC ||
+	    le32_to_cpu(blob->version) != TEVS_PRESET_VERSION)
+		return -EINVAL;
+
+	presets = kcalloc(TEVS_PRESET_SLOTS, sizeof(*presets), GFP_KERNEL);
+	if (!presets)
+		return -ENOMEM;
+
+	mutex_lock(&tevs->mutex);
+	for (i = 0; i < TEVS_PRESET_SLOTS; i++) {
+		preset = &presets[i];
+		memcpy(preset->name, blob->slots[i].name, sizeof(preset->name));
+		preset->count = le32_to_cpu(blob->slots[i].count);
+		/* A free slot must be empty, a save would take it over */
+		if (strnlen(preset->name, TEVS_PRESET_NAME_LEN) ==
+			    TEVS_PRESET_NAME_LEN ||
+		    strchr(preset->name, ',') ||
+		    (!preset->name[0] && preset->count) ||
+		    preset->count > TEVS_PRESET_CTRLS) {
+			ret = -EINVAL;
+			goto unlock;
+		}
+
+		/* Values are range checked when the preset is applied */
+		for (j = 0; j < preset->count; j++) {
+			preset->ctrls[j].id =
+				le32_to_cpu(blob->slots[i].ctrls[j].id);
+			preset->ctrls[j].val =
+				le32_to_cpu(blob->slots[i].ctrls[j].val);
+			if (!tevs_preset_ctrl(tevs, preset->ctrls[j].id)) {
+				ret = -EINVAL;
+				goto unlock;
+			}
+		}
+	}
+	memcpy(tevs->presets, presets, sizeof(tevs->presets));
+
+unlock:
+	mutex_unlock(&tevs->mutex);
+	kfree(presets);
+
+	return ret;
+}
+
+static BIN_ATTR_RW(presets, sizeof(struct tevs_preset_blob));
+
+struct tevs_sensor_op {
+	u16 addr;
 	u16 val;
+	bool write;
+};
+
+/*
+ * debugfs sensor_regs takes a batch of sensor register accesses, one per
+ * line or separated by ';', as "r <addr>" or "w <addr> <val>" in hex. The
+ * batch runs as one sequence under the device locks, reading the file
+ * back gives the value of each access of the last batch.
+ */
+static ssize_t tevs_sensor_regs_write(struct file *file,
+				      const char __user *ubuf, size_t count,
+				      loff_t *ppos)
+{
+	struct tevs *tevs = file->private_data;
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	struct tevs_sensor_op *batch, *op;
+	char *text, *cur, *line, *result;
+	size_t len = 0, size;
+	unsigned int i, n = 0;
+	int ret = 0;
+
+	if (*ppos || count > PAGE_SIZE)
+		return -EINVAL;
+
+	text = memdup_user_nul(ubuf, count);
+	if (IS_ERR(text))
+		return PTR_ERR(text);
+
+	batch = kcalloc(TEVS_SENSOR_BATCH_MAX, sizeof(*batch), GFP_KERNEL);
+	/* "w xxxx xxxx\n" per access and an error line */
+	size = (TEVS_SENSOR_BATCH_MAX + 1) * 16;
+	result = kzalloc(size, GFP_KERNEL);
+	if (!batch || !result) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Parsed whole first, a malformed batch touches nothing */
+	cur = text;
+	while ((line = strsep(&cur, "\n;"))) {
+		line = skip_spaces(line);
+		if (!*line)
+			continue;
+		if (n == TEVS_SENSOR_BATCH_MAX) {
+			ret = -E2BIG;
+			goto out;
+		}
+
+		op = &batch[n++];
+		if (sscanf(line, "w %hx %hx", &op->addr, &op->val) == 2) {
+			op->write = true;
+		} else if (sscanf(line, "r %hx", &op->addr) != 1) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	ret = pm_runtime_resume_and_get(&client->dev);
+	if (ret)
+		goto out;
+
+	mutex_lock(&tevs->mutex);
+	mutex_lock(&tevs->i2c_lock);
+	for (i = 0; i < n && !ret; i++) {
+		op = &batch[i];
+		if (op->write)
+			ret = tevs_sensor_write(tevs, op->addr, op->val);
+		else
+			ret = tevs_sensor_read(tevs, op->addr, &op->val);
+		if (!ret)
+			len += scnprintf(result + len, size - len,
+					 "%c %04x %04x\n", op->write ? 'w' : 'r',
+					 op->addr, op->val);
+	}
+	mutex_unlock(&tevs->i2c_lock);
+	if (ret)
+		len += scnprintf(result + len, size - len, "error %d\n", ret);
+
+	swap(tevs->sensor_result, result);
+	tevs->sensor_result_len = len;
+	mutex_unlock(&tevs->mutex);
+	pm_runtime_put(&client->dev);
+
+out:
+	kfree(result);
+	kfree(batch);
+	kfree(text);
+
+	return ret ? ret : count;
+}
+
+static ssize_t tevs_sensor_regs_read(struct file *file, char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	struct tevs *tevs = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&tevs->mutex);
+	ret = simple_read_from_buffer(ubuf, count, ppos, tevs->sensor_result,
+				      tevs->sensor_result_len);
+	mutex_unlock(&tevs->mutex);
+
+	return ret;
+}
+
+static const struct file_operations tevs_sensor_regs_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = tevs_sensor_regs_read,
+	.write = tevs_sensor_regs_write,
+	.llseek = default_llseek,
+};
+
+/* The host command pages, each fetched in a single bulk read */
+static const struct {
+	u16 base;
+	u16 size;
+} tevs_dump_pages[] = {
+	{ HOST_COMMAND_TEVS_INFO_VERSION_MSB,
+	  HOST_COMMAND_ISP_CTRL_MIPI_FREQ + 2 -
+		  HOST_COMMAND_TEVS_INFO_VERSION_MSB },
+	{ HOST_COMMAND_ISP_BOOTDATA_1,
+	  HOST_COMMAND_ISP_BOOTDATA_63 + 2 - HOST_COMMAND_ISP_BOOTDATA_1 },
+};
+
+static int tevs_regs_show(struct seq_file *s, void *unused)
+{
+	struct tevs *tevs = s->private;
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	unsigned int i, offset;
+	u8 *data;
+	int ret;
+
+	data = kmalloc(tevs_dump_pages[0].size, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	ret = pm_runtime_resume_and_get(&client->dev);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(tevs_dump_pages) && !ret; i++) {
+		ret = tevs_i2c_read(tevs, tevs_dump_pages[i].base, data,
+				    tevs_dump_pages[i].size);
+		for (offset = 0; !ret && offset < tevs_dump_pages[i].size;
+		     offset += 16)
+			seq_printf(s, "%04x: %*ph\n",
+				   tevs_dump_pages[i].base + offset,
+				   (int)min_t(unsigned int, 16,
+					      tevs_dump_pages[i].size - offset),
+				   &data[offset]);
+	}
+	pm_runtime_put(&client->dev);
+
+out:
+	kfree(data);
+
+	return ret;
+}
+DEFINE_SHOW_ATTRIBUTE(tevs_regs);
+
+static void tevs_debugfs_init(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	char name[32];
+
+	snprintf(name, sizeof(name), "tevs-%s", dev_name(&client->dev));
+	tevs->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("sensor_regs", 0600, tevs->debugfs, tevs,
+			    &tevs_sensor_regs_fops);
+	debugfs_create_file("regs", 0400, tevs->debugfs, tevs,
+			    &tevs_regs_fops);
+}
+
+static int tevs_ctrls_init(struct tevs *tevs)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&tevs->v4l2_subdev);
+	struct v4l2_ctrl *hdr_ctrl, *ctrl;
+	unsigned int i;
 	int ret;
 
+	tevs->ctrl_list = devm_kcalloc(&client->dev, ARRAY_SIZE(tevs_ctrls),
+				       sizeof(*tevs->ctrl_list), GFP_KERNEL);
+	if (!tevs->ctrl_list)
+		return -ENOMEM;
+
 	ret = v4l2_ctrl_handler_init(&tevs->ctrls, ARRAY_SIZE(tevs_ctrls));
 	if (ret)
 		return ret;
 
 	for (i = 0; i < ARRAY_SIZE(tevs_ctrls); i++) {
-		struct v4l2_ctrl *ctrl = v4l2_ctrl_new_custom(
-			&tevs->ctrls, &tevs_ctrls[i], NULL);
+		ctrl = v4l2_ctrl_new_custom(&tevs->ctrls, &tevs_ctrls[i].cfg,
+					    (void *)&tevs_ctrls[i]);
+		tevs->ctrl_list[i] = ctrl;
+		/* Volatile controls are read on demand, no default to refresh */
+		if (!ctrl || (ctrl->flags & V4L2_CTRL_FLAG_VOLATILE))
+			continue;
+
 		ret = tevs_g_ctrl(ctrl);
 		if (!ret && ctrl->default_value != ctrl->val) {
 			// Updating default value based on firmware values
@@ -1703,171 +5681,21 @@ static int tevs_ctrls_init(struct tevs *tevs)
 			ctrl->cur.val = ctrl->val;
 		}
 		// Updating maximum and minimum value
-		switch (ctrl->id) {
-		case V4L2_CID_BRIGHTNESS:
-            // get brightness maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_BRIGHTNESS_MASK;
-            // get brightness minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_BRIGHTNESS_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_BRIGHTNESS_MASK;
-			break;
-		case V4L2_CID_CONTRAST:
-            // get contrast maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_CONTRAST_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_CONTRAST_MASK;
-            // get contrast minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_CONTRAST_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_CONTRAST_MASK;
-			break;
-		case V4L2_CID_SATURATION:
-            // get saturation maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_SATURATION_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_SATURATION_MASK;
-            // get saturation minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_SATURATION_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_SATURATION_MASK;
-			break;
-		case V4L2_CID_GAMMA:
-            // get gamma maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_GAMMA_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_GAMMA_MASK;
-            // get gamma minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_GAMMA_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_GAMMA_MASK;
-			break;
-		case V4L2_CID_EXPOSURE: {
-            u8 exp[4] = { 0 };
-            // get exposure time maximum value 
-            ret = tevs_i2c_read(tevs,TEVS_AE_MANUAL_EXP_TIME_MAX, exp, 4);
-            if (ret)
-			    break;
-
-            ctrl->maximum = be32_to_cpup((__be32*)exp);
-            // get exposure time minimum value 
-            ret = tevs_i2c_read(tevs,TEVS_AE_MANUAL_EXP_TIME_MIN, exp, 4);
-            if (ret)
-			    break;
-
-            ctrl->minimum = be32_to_cpup((__be32*)exp);
-            break;
-        }
-		case V4L2_CID_GAIN:
-            // get exposure gain maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_AE_MANUAL_GAIN_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_AE_MANUAL_GAIN_MASK;
-            // get exposure gamma minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_AE_MANUAL_GAIN_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_AE_MANUAL_GAIN_MASK;
-			break;
-		case V4L2_CID_WHITE_BALANCE_TEMPERATURE:
-            // get white balance temperature maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_AWB_MANUAL_TEMP_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_AWB_MANUAL_TEMP_MASK;
-            // get white balance temperature minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_AWB_MANUAL_TEMP_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_AWB_MANUAL_TEMP_MASK;
-			break;
-		case V4L2_CID_SHARPNESS:
-            // get sharpness maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_SHARPEN_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_SHARPEN_MASK;
-            // get sharpness minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_SHARPEN_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_SHARPEN_MASK;
-			break;
-		case V4L2_CID_BACKLIGHT_COMPENSATION:
-            // get backlight compensation maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_BACKLIGHT_COMPENSATION_MAX,
-                                &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_BACKLIGHT_COMPENSATION_MASK;
-            // get backlight compensation minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_BACKLIGHT_COMPENSATION_MIN,
-                                &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_BACKLIGHT_COMPENSATION_MASK;
-			break;
-		case V4L2_CID_PAN_ABSOLUTE:
-		case V4L2_CID_TILT_ABSOLUTE:
-            // get pan and tilt maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_DZ_CT_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_DZ_CT_X_MASK;
-            // get pan and tilt minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_DZ_CT_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_DZ_CT_X_MASK;
-			break;
-		case V4L2_CID_ZOOM_ABSOLUTE:
-            // get zoom absolute maximum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_DZ_TGT_FCT_MAX, &val);
-            if (ret)
-			    break;
-
-            ctrl->maximum = val & TEVS_DZ_TGT_FCT_MASK;
-            // get zoom absolute minimum value
-            ret = tevs_i2c_read_16b(tevs, TEVS_DZ_TGT_FCT_MIN, &val);
-            if (ret)
-			    break;
-
-            ctrl->minimum = val & TEVS_DZ_TGT_FCT_MASK;
-			break;            
-		default:
-			break;
-		}
+		tevs_ctrl_range(tevs, ctrl);
 	}
 
+	/* The still mode indexes into the resolution list of the sensor */
+	ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_TEVS_STILL_MODE);
+	if (ctrl)
+		ctrl->maximum =
+			tevs_sensor_table[tevs->selected_sensor].res_list_size - 1;
+
+	/* Only the test patterns of the sensor are offered */
+	ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_TEST_PATTERN);
+	if (ctrl)
+		ctrl->menu_skip_mask =
+			~(u64)tevs_sensor_table[tevs->selected_sensor].test_patterns;
+
 	if (tevs->ctrls.error) {
 		dev_err(&client->dev, "ctrls error\n");
 		ret = tevs->ctrls.error;
@@ -1875,6 +5703,30 @@ static int tevs_ctrls_init(struct tevs *tevs)
 		return ret;
 	}
 
+	tevs->exposure_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_EXPOSURE);
+	tevs->gain_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_GAIN);
+	tevs->exposure_auto_ctrl =
+		v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_EXPOSURE_AUTO);
+	tevs->flicker_ctrl =
+		v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_POWER_LINE_FREQUENCY);
+	tevs->denoise_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_TEVS_DENOISE);
+	tevs->sharpen_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_SHARPNESS);
+	tevs->colorfx_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_COLORFX);
+	tevs->pan_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_PAN_ABSOLUTE);
+	tevs->zoom_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_ZOOM_ABSOLUTE);
+
+	hdr_ctrl = v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_WIDE_DYNAMIC_RANGE);
+	if (tevs_sensor_has_hdr(tevs))
+		tevs->hdr = hdr_ctrl->val;
+	else
+		v4l2_ctrl_activate(hdr_ctrl, false);
+
+	/* Start from the viewport the firmware booted with */
+	tevs->eptz.pos[TEVS_EPTZ_PAN] = tevs->pan_ctrl->val;
+	tevs->eptz.pos[TEVS_EPTZ_TILT] =
+		v4l2_ctrl_find(&tevs->ctrls, V4L2_CID_TILT_ABSOLUTE)->val;
+	tevs->eptz.pos[TEVS_EPTZ_ZOOM] = tevs->zoom_ctrl->val;
+
 	/* Use same mutex for controls as for everything else. */
 	tevs->ctrls.lock = &tevs->mutex;
 	tevs->v4l2_subdev.ctrl_handler = &tevs->ctrls;
@@ -1884,8 +5736,10 @@ static int tevs_ctrls_init(struct tevs *tevs)
 
 static void tevs_ctrls_free(struct tevs *tevs)
 {
-    v4l2_ctrl_handler_free(&tevs->ctrls);
+	v4l2_ctrl_handler_free(&tevs->ctrls);
+	mutex_destroy(&tevs->i2c_lock);
 	mutex_destroy(&tevs->mutex);
+	mutex_destroy(&tevs->stream_lock);
 }
 
 static int tevs_check_hwcfg(struct device *dev)
@@ -1893,7 +5747,9 @@ static int tevs_check_hwcfg(struct device *dev)
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
 	struct tevs *tevs = to_tevs(sub_dev);
-    int ret = 0;
+	const char *sync_role;
+	int ret = 0;
+
 	tevs->reset_gpio =
 		devm_gpiod_get_optional(dev, "VANA-supply", GPIOD_OUT_HIGH);
 	if (IS_ERR(tevs->reset_gpio)) {
@@ -1912,6 +5768,42 @@ static int tevs_check_hwcfg(struct device *dev)
 		return ret;
 	}
 
+	tevs->trigger_gpio =
+		devm_gpiod_get_optional(dev, "trigger", GPIOD_OUT_LOW);
+	if (IS_ERR(tevs->trigger_gpio)) {
+		ret = PTR_ERR(tevs->trigger_gpio);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Cannot get trigger GPIO (%d)", ret);
+		return ret;
+	}
+
+	tevs->shutter_gpio =
+		devm_gpiod_get_optional(dev, "shutter", GPIOD_IN);
+	if (IS_ERR(tevs->shutter_gpio)) {
+		ret = PTR_ERR(tevs->shutter_gpio);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Cannot get shutter GPIO (%d)", ret);
+		return ret;
+	}
+
+	tevs->frame_sync_gpio =
+		devm_gpiod_get_optional(dev, "frame-sync", GPIOD_IN);
+	if (IS_ERR(tevs->frame_sync_gpio)) {
+		ret = PTR_ERR(tevs->frame_sync_gpio);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Cannot get frame-sync GPIO (%d)", ret);
+		return ret;
+	}
+
+	tevs->flash_gpio =
+		devm_gpiod_get_optional(dev, "flash", GPIOD_OUT_LOW);
+	if (IS_ERR(tevs->flash_gpio)) {
+		ret = PTR_ERR(tevs->flash_gpio);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Cannot get flash GPIO (%d)", ret);
+		return ret;
+	}
+
 	tevs->data_lanes = 0;
 	if (of_property_read_u32(dev->of_node, "data-lanes", &tevs->data_lanes) ==
 	    0) {
@@ -1945,16 +5837,44 @@ static int tevs_check_hwcfg(struct device *dev)
 	tevs->hw_reset_mode =
 		of_property_read_bool(dev->of_node, "hw-reset");
 
-	tevs->trigger_mode = 
+	tevs->trigger_mode =
 		of_property_read_bool(dev->of_node, "trigger-mode");
 
+	tevs->sync_role = TEVS_SYNC_ROLE_FREE_RUN;
+	if (of_property_read_string(dev->of_node, "sync-role", &sync_role) ==
+	    0) {
+		ret = match_string(tevs_sync_role_names,
+				   ARRAY_SIZE(tevs_sync_role_names), sync_role);
+		if (ret < 0) {
+			dev_err(dev,
+				"value of 'sync-role' property is invaild\n");
+			return -EINVAL;
+		}
+		tevs->sync_role = ret;
+		ret = 0;
+	}
+
+	tevs->sync_group = 0;
+	of_property_read_u32(dev->of_node, "sync-group", &tevs->sync_group);
+
+	tevs->frame_sync_poll_us = 0;
+	if (of_property_read_u32(dev->of_node, "frame-sync-poll-us",
+				 &tevs->frame_sync_poll_us) == 0) {
+		if (tevs->frame_sync_poll_us < TEVS_FRAME_SYNC_POLL_MIN_US ||
+		    tevs->frame_sync_poll_us > TEVS_FRAME_SYNC_POLL_MAX_US) {
+			dev_err(dev,
+				"value of 'frame-sync-poll-us' property is invaild\n");
+			return -EINVAL;
+		}
+	}
+
 	dev_dbg(dev,
 		"data-lanes [%d], continuous-clock [%d], hw-reset [%d], "
-        "trigger-mode [%d]\n",
-		tevs->data_lanes, tevs->continuous_clock, tevs->hw_reset_mode, 
-        tevs->trigger_mode);
+		"trigger-mode [%d]\n",
+		tevs->data_lanes, tevs->continuous_clock, tevs->hw_reset_mode,
+		tevs->trigger_mode);
 
-    return ret;
+	return ret;
 }
 
 static int tevs_probe(struct i2c_client *client)
@@ -1963,6 +5883,7 @@ static int tevs_probe(struct i2c_client *client)
 	struct tevs *tevs = NULL;
 	struct v4l2_mbus_framefmt *fmt;
 	int i = ARRAY_SIZE(tevs_sensor_table);
+	int irq;
 	int ret;
 
 	dev_info(dev, "%s() device node: %s\n", __func__,
@@ -1977,6 +5898,30 @@ static int tevs_probe(struct i2c_client *client)
 	v4l2_i2c_subdev_init(&tevs->v4l2_subdev, client, &tevs_subdev_ops);
 
 	i2c_set_clientdata(client, tevs);
+	mutex_init(&tevs->stream_lock);
+	mutex_init(&tevs->mutex);
+	mutex_init(&tevs->i2c_lock);
+	seqlock_init(&tevs->snapshot_lock);
+	hrtimer_init(&tevs->frame_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	tevs->frame_timer.function = tevs_frame_timer_handler;
+	INIT_WORK(&tevs->frame_work, tevs_frame_work);
+	INIT_WORK(&tevs->frame_sync_work, tevs_frame_sync_work);
+	INIT_WORK(&tevs->sync_work, tevs_sync_work);
+	INIT_WORK(&tevs->still.work, tevs_still_work);
+	INIT_WORK(&tevs->strobe_work, tevs_strobe_work);
+	INIT_WORK(&tevs->stream_work, tevs_stream_work);
+	INIT_DELAYED_WORK(&tevs->cmdq.work, tevs_cmdq_work);
+	INIT_DELAYED_WORK(&tevs->watchdog.work, tevs_watchdog_work);
+	tevs->bracket.index = -1;
+	tevs->ae_priority = true;
+	tevs->trigger_pulse = TEVS_TRIGGER_PULSE_US;
+	tevs->strobe_source = V4L2_FLASH_STROBE_SOURCE_EXTERNAL;
+	tevs->strobe_duration = TEVS_STROBE_DURATION_DEF;
+	tevs->strobe_interval = 1;
+	tevs->seed.enabled = true;
+	tevs->still.frames = 1;
+	tevs->watchdog.enabled = true;
+
 	tevs->regmap = devm_regmap_init_i2c(client, &tevs_regmap_config);
 	if (IS_ERR(tevs->regmap)) {
 		dev_err(dev, "Unable to initialize I2C\n");
@@ -1999,20 +5944,9 @@ static int tevs_probe(struct i2c_client *client)
 		return ret;
 	}
 
-	if (tevs->data_frequency != 0) {
-		ret = tevs_i2c_write_16b(tevs,
-					HOST_COMMAND_ISP_CTRL_MIPI_FREQ,
-					tevs->data_frequency);
-		msleep(TEVS_BOOT_TIME);
-		if (tevs_check_boot_state(tevs) != 0) {
-			dev_err(dev, "check tevs bootup status failed\n");
-			return -EINVAL;
-		}
-		if (ret < 0) {
-			dev_err(dev, "set mipi frequency failed\n");
-			return -EINVAL;
-		}
-	}
+	ret = tevs_mipi_freq_apply(tevs);
+	if (ret)
+		return ret;
 
 	ret = tevs_check_version(tevs);
 	if (ret < 0) {
@@ -2052,6 +5986,9 @@ static int tevs_probe(struct i2c_client *client)
 	dev_dbg(dev, "selected_sensor:%d, sensor_name:%s\n", i,
 		tevs->header_info->product_name);
 
+	/* Stills default to the largest size of the sensor */
+	tevs->still.mode = tevs_sensor_table[i].res_list_size - 1;
+
 	/* Initialize default format */
 	fmt = &tevs->fmt;
 	fmt->width =
@@ -2065,12 +6002,52 @@ static int tevs_probe(struct i2c_client *client)
 	fmt->quantization = V4L2_QUANTIZATION_FULL_RANGE;
 	fmt->xfer_func = V4L2_MAP_XFER_FUNC_DEFAULT(fmt->colorspace);
 	// memset(fmt->reserved, 0, sizeof(fmt->reserved));
-    
+
 	ret = tevs_ctrls_init(tevs);
 	if (ret) {
 		dev_err(&client->dev, "failed to init controls: %d", ret);
 		goto error_power_off;
 	}
+	tevs_snapshot_publish(tevs);
+
+	ret = device_create_bin_file(dev, &bin_attr_presets);
+	if (ret) {
+		dev_err(dev, "failed to create presets file: %d\n", ret);
+		goto error_handler_free;
+	}
+
+	if (tevs->shutter_gpio) {
+		irq = gpiod_to_irq(tevs->shutter_gpio);
+		ret = irq < 0 ? irq :
+			devm_request_threaded_irq(dev, irq, NULL,
+				tevs_shutter_irq,
+				IRQF_TRIGGER_RISING | IRQF_ONESHOT,
+				"tevs-shutter", tevs);
+		if (ret)
+			dev_warn(dev, "no shutter events, irq failed: %d\n",
+				 ret);
+		else
+			tevs->shutter_irq = irq;
+	}
+
+	if (tevs->frame_sync_gpio) {
+		irq = gpiod_to_irq(tevs->frame_sync_gpio);
+		ret = irq < 0 ? irq :
+			devm_request_threaded_irq(dev, irq, NULL,
+				tevs_frame_sync_irq,
+				IRQF_TRIGGER_RISING | IRQF_ONESHOT,
+				"tevs-frame-sync", tevs);
+		if (!ret) {
+			tevs->frame_sync_irq = irq;
+		} else if (tevs->frame_sync_poll_us) {
+			dev_info(dev, "polling frame-sync every %u us, irq failed: %d\n",
+				 tevs->frame_sync_poll_us, ret);
+		} else {
+			dev_warn(dev, "no frame-sync events, irq failed: %d\n",
+				 ret);
+			tevs->frame_sync_gpio = NULL;
+		}
+	}
 
     /* Initialize subdev */
 	tevs->v4l2_subdev.internal_ops = &tevs_internal_ops;
@@ -2085,13 +6062,23 @@ static int tevs_probe(struct i2c_client *client)
 	ret = media_entity_pads_init(&tevs->v4l2_subdev.entity, 1, &tevs->pad);
 	if (ret) {
 		dev_err(dev, "failed to init entity pads: %d\n", ret);
-		goto error_handler_free;
+		goto error_presets;
+	}
+
+	mutex_lock(&tevs_sync_lock);
+	if (tevs->sync_role == TEVS_SYNC_ROLE_MASTER &&
+	    tevs_sync_master(tevs)) {
+		dev_warn(dev, "sync group %u has a master, running free\n",
+			 tevs->sync_group);
+		tevs->sync_role = TEVS_SYNC_ROLE_FREE_RUN;
 	}
+	list_add_tail(&tevs->sync_entry, &tevs_sync_list);
+	mutex_unlock(&tevs_sync_lock);
 
 	ret = v4l2_async_register_subdev_sensor(&tevs->v4l2_subdev);
 	if (ret != 0) {
 		dev_err(dev, "failed to register sensor sub-device: %d\n", ret);
-		goto error_media_entity;
+		goto error_sync_list;
 	}
 
     dev_info(dev, "probe success\n");
@@ -2101,11 +6088,17 @@ static int tevs_probe(struct i2c_client *client)
 	pm_runtime_enable(dev);
 	pm_runtime_idle(dev);
 
+	tevs_debugfs_init(tevs);
+
 	return 0;
 
-error_media_entity:
+error_sync_list:
+	tevs_sync_leave(tevs);
 	media_entity_cleanup(&tevs->v4l2_subdev.entity);
 
+error_presets:
+	device_remove_bin_file(dev, &bin_attr_presets);
+
 error_handler_free:
 	tevs_ctrls_free(tevs);
 
@@ -2120,9 +6113,31 @@ static void tevs_remove(struct i2c_client *client)
 	struct v4l2_subdev *sub_dev = i2c_get_clientdata(client);
 	struct tevs *tevs = to_tevs(sub_dev);
 
+	debugfs_remove_recursive(tevs->debugfs);
+	device_remove_bin_file(&client->dev, &bin_attr_presets);
 	v4l2_async_unregister_subdev(sub_dev);
+	tevs_sync_leave(tevs);
+	/* The trigger group must not keep pulsing a freed member */
+	mutex_lock(&tevs->stream_lock);
+	tevs_trigger_gen_stop(tevs);
+	mutex_unlock(&tevs->stream_lock);
+	/* The devm IRQs outlive remove, no edge may queue work from here on */
+	if (tevs->shutter_irq > 0)
+		disable_irq(tevs->shutter_irq);
+	if (tevs->frame_sync_irq > 0)
+		disable_irq(tevs->frame_sync_irq);
+	/* A queued standby still drops its power reference */
+	flush_work(&tevs->stream_work);
+	cancel_work_sync(&tevs->strobe_work);
+	cancel_delayed_work_sync(&tevs->cmdq.work);
+	cancel_delayed_work_sync(&tevs->watchdog.work);
+	hrtimer_cancel(&tevs->frame_timer);
+	cancel_work_sync(&tevs->frame_work);
+	cancel_work_sync(&tevs->frame_sync_work);
+	cancel_work_sync(&tevs->still.work);
 	media_entity_cleanup(&sub_dev->entity);
-    tevs_ctrls_free(tevs);
+	tevs_ctrls_free(tevs);
+	kfree(tevs->sensor_result);
 
 	pm_runtime_disable(&client->dev);
 	if (!pm_runtime_status_suspended(&client->dev))
@@ -1,6 +1,26 @@
 #ifndef __SENSOR_TABLES_H__
 #define __SENSOR_TABLES_H__
 
+/* onsemi sensor registers, reached through the ISP I2C_ADDR/I2C_DATA pair */
+#define AR_TEST_PATTERN_MODE              (0x3070)
+#define AR_TEST_DATA_RED                  (0x3072)
+#define AR_TEST_DATA_GREENR               (0x3074)
+#define AR_TEST_DATA_BLUE                 (0x3076)
+#define AR_TEST_DATA_GREENB               (0x3078)
+
+/* V4L2_CID_TEST_PATTERN menu items */
+#define TEVS_TEST_PATTERN_DISABLED        (0)
+#define TEVS_TEST_PATTERN_SOLID           (1)
+#define TEVS_TEST_PATTERN_BARS            (2)
+#define TEVS_TEST_PATTERN_FADE            (3)
+#define TEVS_TEST_PATTERN_WALKING_1S      (4)
+#define TEVS_TEST_PATTERN_COUNTER         (5) /* solid, level set per frame */
+
+#define AR_TEST_PATTERNS                                                       \
+	(BIT(TEVS_TEST_PATTERN_DISABLED) | BIT(TEVS_TEST_PATTERN_SOLID) |      \
+	 BIT(TEVS_TEST_PATTERN_BARS) | BIT(TEVS_TEST_PATTERN_FADE) |           \
+	 BIT(TEVS_TEST_PATTERN_COUNTER))
+
 struct resolution {
 	u16 width;
 	u16 height;
@@ -68,30 +88,41 @@ struct sensor_info {
 	const char *sensor_name;
 	const struct resolution *res_list;
 	u32 res_list_size;
+	u32 test_patterns; /* mask of the supported TEVS_TEST_PATTERN_* */
+	u8 hdr_exposures; /* exposures read out per HDR frame, 0 without HDR */
 };
 
 static struct sensor_info tevs_sensor_table[] = {
 	{ .sensor_name = "TEVS-AR0144",
 	  .res_list = ar0144_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0144_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0144_res_list),
+	  .test_patterns = AR_TEST_PATTERNS | BIT(TEVS_TEST_PATTERN_WALKING_1S) },
 	{ .sensor_name = "TEVS-AR0234",
 	  .res_list = ar0234_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0234_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0234_res_list),
+	  .test_patterns = AR_TEST_PATTERNS | BIT(TEVS_TEST_PATTERN_WALKING_1S) },
 	{ .sensor_name = "TEVS-AR0521",
 	  .res_list = ar0521_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0521_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0521_res_list),
+	  .test_patterns = AR_TEST_PATTERNS },
 	{ .sensor_name = "TEVS-AR0522",
 	  .res_list = ar0522_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0522_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0522_res_list),
+	  .test_patterns = AR_TEST_PATTERNS },
 	{ .sensor_name = "TEVS-AR0821",
 	  .res_list = ar0821_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0821_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0821_res_list),
+	  .test_patterns = AR_TEST_PATTERNS,
+	  .hdr_exposures = 2 },
 	{ .sensor_name = "TEVS-AR0822",
 	  .res_list = ar0822_res_list,
-	  .res_list_size = ARRAY_SIZE(ar0822_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar0822_res_list),
+	  .test_patterns = AR_TEST_PATTERNS,
+	  .hdr_exposures = 2 },
 	{ .sensor_name = "TEVS-AR1335",
 	  .res_list = ar1335_res_list,
-	  .res_list_size = ARRAY_SIZE(ar1335_res_list) },
+	  .res_list_size = ARRAY_SIZE(ar1335_res_list),
+	  .test_patterns = AR_TEST_PATTERNS },
 };
 
-#endif //__SENSOR_TABLES_H__
\ No newline at end of file
+#endif //__SENSOR_TABLES_H__